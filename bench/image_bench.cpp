@@ -0,0 +1,108 @@
+// Compares the spectrogram image formats on encoded size and encoding
+// time, against plain P2 as the baseline.
+//
+//     image_bench [width] [height] [uint8|uint16|float]
+//
+// The spectrogram is synthetic: a few overlapping radial blobs over an
+// empty background, roughly what a rasterized model looks like.
+
+#include "image_export.h"
+#include "spectrogram.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static const int RUNS = 5;
+
+static Spectrogram syntheticSpectrogram(int _width, int _height, SpectrogramFormat _format)
+{
+    Spectrogram spectrogram(_width, _height, _format);
+
+    const int blobs_count = 6;
+    const double blobs[blobs_count][3] = {
+        {0.30, 0.40, 0.22}, {0.55, 0.50, 0.30}, {0.70, 0.30, 0.15},
+        {0.20, 0.75, 0.12}, {0.80, 0.80, 0.18}, {0.50, 0.15, 0.10}};
+
+    withSampleType(_format, [&](auto _sample)
+    {
+        using T = decltype(_sample);
+        T *data = spectrogram.data<T>();
+
+        for (int y = 0; y < _height; y++)
+        {
+            for (int x = 0; x < _width; x++)
+            {
+                double value = 0.0;
+                for (int blob = 0; blob < blobs_count; blob++)
+                {
+                    double dx = ((double)x / _width) - blobs[blob][0];
+                    double dy = ((double)y / _height) - blobs[blob][1];
+                    double distance = std::sqrt((dx * dx) + (dy * dy)) / blobs[blob][2];
+                    if (distance < 1.0)
+                        value = std::max(value, 1.0 - distance);
+                }
+                data[((size_t)y * _width) + x] = (T)(value * SampleTraits<T>::max_value);
+            }
+        }
+    });
+
+    return spectrogram;
+}
+
+int main(int argc, char **argv)
+{
+    int width = (argc > 1) ? atoi(argv[1]) : 1000;
+    int height = (argc > 2) ? atoi(argv[2]) : 1000;
+    SpectrogramFormat format = SPECTROGRAM_UINT8;
+    if (argc > 3 && strcmp(argv[3], "uint16") == 0)
+        format = SPECTROGRAM_UINT16;
+    else if (argc > 3 && strcmp(argv[3], "float") == 0)
+        format = SPECTROGRAM_FLOAT;
+
+    Spectrogram spectrogram = syntheticSpectrogram(width, height, format);
+
+    const struct
+    {
+        ImageFileFormat format;
+        const char *name;
+    } formats[] = {
+        {IMAGE_PGM_ASCII, "P2"},
+        {IMAGE_PGM_8, "P5 8 bit"},
+        {IMAGE_PGM_16, "P5 16 bit"},
+        {IMAGE_PNG_8, "PNG 8 bit"},
+        {IMAGE_PNG_16, "PNG 16 bit"},
+        {IMAGE_PNG_COLORMAP, "PNG colormap"},
+    };
+
+    printf("%dx%d, %d threads, best of %d runs\n", width, height, ThreadPool::instance().getThreadsCount(), RUNS);
+    printf("%-14s %12s %8s %10s %8s\n", "format", "bytes", "size", "ms", "speed");
+
+    size_t baseline_size = 0;
+    double baseline_ms = 0.0;
+    for (const auto &entry : formats)
+    {
+        size_t size = 0;
+        double best_ms = 1e30;
+        for (int run = 0; run < RUNS; run++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            std::vector<uint8_t> image = encodeImage(spectrogram, entry.format);
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            size = image.size();
+            best_ms = std::min(best_ms, ms);
+        }
+
+        if (entry.format == IMAGE_PGM_ASCII)
+        {
+            baseline_size = size;
+            baseline_ms = best_ms;
+        }
+        printf("%-14s %12zu %7.1f%% %10.2f %7.2fx\n", entry.name, size, (100.0 * size) / baseline_size, best_ms, baseline_ms / best_ms);
+    }
+    return 0;
+}
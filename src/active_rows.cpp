@@ -0,0 +1,143 @@
+#include "active_rows.h"
+#include "buffer_layout.h"
+#include "thread_pool.h"
+#include <algorithm>
+
+// Columns are indexed in bands of this many, one pool task per band. Each
+// band reads the spectrogram row by row, a band wide at a time.
+static const int COLUMNS_PER_BAND = 64;
+
+void ActiveRows::build(const Spectrogram &_spectrogram)
+{
+    const int width = _spectrogram.getWidth();
+    const int height = _spectrogram.getHeight();
+    const int bands_count = (width + COLUMNS_PER_BAND - 1) / COLUMNS_PER_BAND;
+
+    this->rows_count = height;
+    this->columns_count = width;
+    this->column_offsets = std::vector<int64_t>(width + 1, 0);
+
+    // Calls _visit(column, row) for every non-zero cell of a band, row by row.
+    auto scanBand = [&_spectrogram, width, height](int _band, auto _visit)
+    {
+        withSampleType(_spectrogram.getFormat(), [&](auto _sample)
+        {
+            const auto *buffer = _spectrogram.data<decltype(_sample)>();
+
+            withBufferLayout(width, [&](auto _layout)
+            {
+                int column_begin = _band * COLUMNS_PER_BAND;
+                int column_end = std::min(width, column_begin + COLUMNS_PER_BAND);
+                for (int row = 0; row < height; row++)
+                {
+                    for (int column = column_begin; column < column_end; column++)
+                    {
+                        if (buffer[_layout.index(column, row)] != 0)
+                            _visit(column, row);
+                    }
+                }
+            });
+        });
+    };
+
+    // First pass: count the rows of every column.
+    TaskGroup counters;
+    for (int band = 0; band < bands_count; band++)
+    {
+        counters.run([this, band, &scanBand]()
+        {
+            scanBand(band, [this](int _column, int)
+            {
+                this->column_offsets[_column + 1]++;
+            });
+        });
+    }
+    counters.wait();
+
+    for (int column = 0; column < width; column++)
+    {
+        this->column_offsets[column + 1] += this->column_offsets[column];
+    }
+
+    this->column_rows = std::vector<int>(this->column_offsets[width]);
+    this->column_rows.shrink_to_fit();
+
+    // Second pass: rows are met in ascending order, so every column's list
+    // comes out sorted.
+    TaskGroup writers;
+    for (int band = 0; band < bands_count; band++)
+    {
+        writers.run([this, band, &scanBand]()
+        {
+            std::vector<int64_t> cursors(
+                this->column_offsets.begin() + (band * COLUMNS_PER_BAND),
+                this->column_offsets.begin() + std::min(this->columns_count, (band + 1) * COLUMNS_PER_BAND));
+
+            scanBand(band, [this, band, &cursors](int _column, int _row)
+            {
+                this->column_rows[cursors[_column - (band * COLUMNS_PER_BAND)]++] = _row;
+            });
+        });
+    }
+    writers.wait();
+}
+
+bool ActiveRows::empty()
+{
+    return this->column_offsets.empty();
+}
+
+int ActiveRows::getRowsCount() const
+{
+    return this->rows_count;
+}
+
+int ActiveRows::getColumnsCount() const
+{
+    return this->columns_count;
+}
+
+int64_t ActiveRows::getEntriesCount() const
+{
+    return this->column_rows.size();
+}
+
+int64_t ActiveRows::columnOffset(int _column) const
+{
+    return this->column_offsets[_column];
+}
+
+int ActiveRows::columnRowsCount(int _column) const
+{
+    return this->column_offsets[_column + 1] - this->column_offsets[_column];
+}
+
+const int *ActiveRows::columnRowsBegin(int _column) const
+{
+    return this->column_rows.data() + this->column_offsets[_column];
+}
+
+const int *ActiveRows::columnRowsEnd(int _column) const
+{
+    return this->column_rows.data() + this->column_offsets[_column + 1];
+}
+
+SparsityStats ActiveRows::getStats() const
+{
+    SparsityStats stats;
+    stats.cells = (int64_t)this->rows_count * this->columns_count;
+    stats.active_cells = getEntriesCount();
+    stats.empty_columns = 0;
+    stats.max_column_rows = 0;
+
+    for (int column = 0; column < this->columns_count; column++)
+    {
+        int rows = columnRowsCount(column);
+        stats.max_column_rows = std::max(stats.max_column_rows, rows);
+        if (rows == 0)
+            stats.empty_columns++;
+    }
+
+    stats.mean_column_rows = this->columns_count ? (double)stats.active_cells / this->columns_count : 0.0;
+    return stats;
+}
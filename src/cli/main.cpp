@@ -0,0 +1,335 @@
+// Headless muser: rasterizes a model, or reads an exported spectrogram,
+// and writes the image and the audio, without a window, a GL context or
+// an audio device.
+//
+//     muser-cli [options] <model.obj | spectrogram.pgm|.ppm|.spec>
+//
+// Models are read through their mesh cache (see openMeshCache), so only
+// the first run on an OBJ file pays for parsing it.
+
+#include "muse.h"
+#include "mesh_cache.h"
+#include "obj_loader.h"
+#include "thread_pool.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+
+struct CliOptions
+{
+    std::string input_path;
+    std::string output_name;
+    int buffer_width = DEFAULT_BUFFER_WIDTH;
+    int buffer_height = DEFAULT_BUFFER_HEIGHT;
+    SpectrogramFormat buffer_format = DEFAULT_BUFFER_FORMAT;
+    // Image and audio formats; empty keeps the muse's default.
+    std::string image_format;
+    std::string wav_format;
+    SynthesisMode synthesis_mode = SYNTHESIS_OSCILLATOR_BANK;
+    double duration = DEFAULT_AUDIO_DURATION;
+    int sample_rate = DEFAULT_SAMPLE_RATE;
+    int channels_count = DEFAULT_CHANNELS_COUNT;
+    int threads_count = 0;
+    bool pin_threads = false;
+    bool use_mesh_cache = true;
+    bool show_help = false;
+};
+
+static void printUsage(FILE *_stream, const char *_program)
+{
+    fprintf(_stream,
+            "usage: %s [options] <model.obj | spectrogram.pgm|.ppm|.spec>\n"
+            "\n"
+            "  -o, --output NAME     base name of the exported files\n"
+            "                        (default: the input's, without extension)\n"
+            "  --width N             spectrogram columns (default %d)\n"
+            "  --height N            spectrogram rows (default %d)\n"
+            "  --buffer FORMAT       uint8, uint16 or float (default uint8)\n"
+            "  --image FORMAT        p2, p5, p5_16, png, png16, png_colormap, spec\n"
+            "                        or none (default: binary at the buffer's\n"
+            "                        precision for models, none for spectrograms)\n"
+            "  --wav FORMAT          pcm16, pcm24, float32 or none (default pcm16)\n"
+            "  --synthesis MODE      oscillator or ifft (default oscillator)\n"
+            "  --duration SECONDS    length of the audio (default %g)\n"
+            "  --sample-rate N       (default %d)\n"
+            "  --channels N          (default %d)\n"
+            "  --threads N           worker threads, 0 for one per hardware thread\n"
+            "  --pin-threads         pin each worker to its own CPU\n"
+            "  --no-cache            read the OBJ file directly, without a mesh cache\n"
+            "  -h, --help            show these options and exit\n",
+            _program, DEFAULT_BUFFER_WIDTH, DEFAULT_BUFFER_HEIGHT,
+            DEFAULT_AUDIO_DURATION, DEFAULT_SAMPLE_RATE, DEFAULT_CHANNELS_COUNT);
+}
+
+static bool isSpectrogramPath(const std::string &_path)
+{
+    for (const char *extension : {".pgm", ".ppm", ".spec"})
+    {
+        size_t length = strlen(extension);
+        if (_path.size() >= length && _path.compare(_path.size() - length, length, extension) == 0)
+            return true;
+    }
+    return false;
+}
+
+static bool parseImageFormat(const std::string &_name, ImageFileFormat &_format)
+{
+    if (_name == "p2")
+        _format = IMAGE_PGM_ASCII;
+    else if (_name == "p5")
+        _format = IMAGE_PGM_8;
+    else if (_name == "p5_16")
+        _format = IMAGE_PGM_16;
+    else if (_name == "png")
+        _format = IMAGE_PNG_8;
+    else if (_name == "png16")
+        _format = IMAGE_PNG_16;
+    else if (_name == "png_colormap")
+        _format = IMAGE_PNG_COLORMAP;
+    else if (_name == "spec")
+        _format = IMAGE_SPECTROGRAM;
+    else
+        return false;
+    return true;
+}
+
+static bool parseWavFormat(const std::string &_name, WavSampleFormat &_format)
+{
+    if (_name == "pcm16")
+        _format = WAV_PCM16;
+    else if (_name == "pcm24")
+        _format = WAV_PCM24;
+    else if (_name == "float32")
+        _format = WAV_FLOAT32;
+    else
+        return false;
+    return true;
+}
+
+// False, after saying why, if the arguments are not usable.
+static bool parseArguments(int _argc, char **_argv, CliOptions &_options)
+{
+    for (int i = 1; i < _argc; i++)
+    {
+        std::string argument = _argv[i];
+
+        if (argument == "-h" || argument == "--help")
+        {
+            _options.show_help = true;
+            return true;
+        }
+        if (argument == "--pin-threads")
+        {
+            _options.pin_threads = true;
+            continue;
+        }
+        if (argument == "--no-cache")
+        {
+            _options.use_mesh_cache = false;
+            continue;
+        }
+        if (argument.empty() || argument[0] != '-')
+        {
+            if (!_options.input_path.empty())
+            {
+                fprintf(stderr, "Only one input file can be given.\n");
+                return false;
+            }
+            _options.input_path = argument;
+            continue;
+        }
+
+        // Every other option takes a value.
+        if (i + 1 >= _argc)
+        {
+            fprintf(stderr, "Missing value for %s.\n", argument.c_str());
+            return false;
+        }
+        std::string value = _argv[++i];
+
+        if (argument == "-o" || argument == "--output")
+            _options.output_name = value;
+        else if (argument == "--width")
+            _options.buffer_width = atoi(value.c_str());
+        else if (argument == "--height")
+            _options.buffer_height = atoi(value.c_str());
+        else if (argument == "--buffer" && value == "uint8")
+            _options.buffer_format = SPECTROGRAM_UINT8;
+        else if (argument == "--buffer" && value == "uint16")
+            _options.buffer_format = SPECTROGRAM_UINT16;
+        else if (argument == "--buffer" && value == "float")
+            _options.buffer_format = SPECTROGRAM_FLOAT;
+        else if (argument == "--image")
+            _options.image_format = value;
+        else if (argument == "--wav")
+            _options.wav_format = value;
+        else if (argument == "--synthesis" && value == "oscillator")
+            _options.synthesis_mode = SYNTHESIS_OSCILLATOR_BANK;
+        else if (argument == "--synthesis" && value == "ifft")
+            _options.synthesis_mode = SYNTHESIS_INVERSE_FFT;
+        else if (argument == "--duration")
+            _options.duration = atof(value.c_str());
+        else if (argument == "--sample-rate")
+            _options.sample_rate = atoi(value.c_str());
+        else if (argument == "--channels")
+            _options.channels_count = atoi(value.c_str());
+        else if (argument == "--threads")
+            _options.threads_count = atoi(value.c_str());
+        else
+        {
+            fprintf(stderr, "Unknown option or value: %s %s.\n", argument.c_str(), value.c_str());
+            return false;
+        }
+    }
+
+    if (_options.input_path.empty())
+    {
+        fprintf(stderr, "No input file given.\n");
+        return false;
+    }
+    if (_options.buffer_width <= 0 || _options.buffer_height <= 0)
+    {
+        fprintf(stderr, "The spectrogram size must be positive.\n");
+        return false;
+    }
+    if (_options.duration <= 0 || _options.sample_rate <= 0 || _options.channels_count <= 0)
+    {
+        fprintf(stderr, "The duration, sample rate and channels must be positive.\n");
+        return false;
+    }
+
+    ImageFileFormat image_format;
+    if (!_options.image_format.empty() && _options.image_format != "none" &&
+        !parseImageFormat(_options.image_format, image_format))
+    {
+        fprintf(stderr, "Unknown image format: %s.\n", _options.image_format.c_str());
+        return false;
+    }
+    WavSampleFormat wav_format;
+    if (!_options.wav_format.empty() && _options.wav_format != "none" &&
+        !parseWavFormat(_options.wav_format, wav_format))
+    {
+        fprintf(stderr, "Unknown audio format: %s.\n", _options.wav_format.c_str());
+        return false;
+    }
+
+    if (_options.output_name.empty())
+    {
+        size_t slash = _options.input_path.find_last_of('/');
+        size_t dot = _options.input_path.find_last_of('.');
+        _options.output_name = (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+                                   ? _options.input_path.substr(0, dot)
+                                   : _options.input_path;
+    }
+
+    return true;
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point _start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count();
+}
+
+int main(int argc, char **argv)
+{
+    CliOptions options;
+    if (!parseArguments(argc, argv, options))
+    {
+        printUsage(stderr, argv[0]);
+        return 2;
+    }
+    if (options.show_help)
+    {
+        printUsage(stdout, argv[0]);
+        return 0;
+    }
+
+    ThreadPool::configure(options.threads_count, options.pin_threads);
+
+    auto start = std::chrono::steady_clock::now();
+    bool from_spectrogram = isSpectrogramPath(options.input_path);
+
+    // The muse keeps the cache mapped; a model read without one is only
+    // freed at exit.
+    std::unique_ptr<Muse> muse;
+    Model model = Model{};
+    if (from_spectrogram)
+    {
+        muse.reset(new Muse(0, options.input_path));
+        if (!muse->bufferReady())
+            return 1;
+    }
+    else
+    {
+        JobProgress progress;
+        std::shared_ptr<MeshCache> mesh_cache;
+        if (options.use_mesh_cache)
+            mesh_cache = openMeshCache(options.input_path, progress);
+
+        if (mesh_cache)
+        {
+            muse.reset(new Muse(0, mesh_cache, options.buffer_width, options.buffer_height, options.buffer_format));
+        }
+        else
+        {
+            if (options.use_mesh_cache)
+                fprintf(stderr, "No mesh cache for \"%s\", reading it directly.\n", options.input_path.c_str());
+
+            if (!loadObjModel(options.input_path, model, progress))
+            {
+                fprintf(stderr, "Could not read \"%s\".\n", options.input_path.c_str());
+                return 1;
+            }
+            muse.reset(new Muse(0, model, Texture2D{}, options.buffer_width, options.buffer_height, options.buffer_format));
+        }
+    }
+    printf("Loaded \"%s\" in %.3f s.\n", options.input_path.c_str(), secondsSince(start));
+
+    muse->setSynthesisMode(options.synthesis_mode);
+    muse->setDuration(options.duration);
+    muse->setSampleRate(options.sample_rate);
+    muse->setChannelsCount(options.channels_count);
+
+    ImageFileFormat image_format;
+    if (parseImageFormat(options.image_format, image_format))
+        muse->setImageFormat(image_format);
+    WavSampleFormat wav_format;
+    if (parseWavFormat(options.wav_format, wav_format))
+        muse->setWavFormat(wav_format);
+
+    bool succeeded = true;
+
+    if (!from_spectrogram)
+    {
+        start = std::chrono::steady_clock::now();
+        muse->rasterizeBuffer();
+        if (!muse->bufferReady())
+        {
+            unloadObjModel(model);
+            return 1;
+        }
+        printf("Rasterized %d triangles in %.3f s.\n", muse->getTriangleCount(), secondsSince(start));
+    }
+
+    bool export_image = from_spectrogram ? !options.image_format.empty() : true;
+    if (export_image && options.image_format != "none")
+    {
+        start = std::chrono::steady_clock::now();
+        succeeded = muse->exportImage(options.output_name) && succeeded;
+        printf("Exported the image in %.3f s.\n", secondsSince(start));
+    }
+
+    if (options.wav_format != "none")
+    {
+        start = std::chrono::steady_clock::now();
+        succeeded = muse->exportAudio(options.output_name) && succeeded;
+        printf("Exported the audio in %.3f s.\n", secondsSince(start));
+    }
+
+    muse.reset();
+    unloadObjModel(model);
+    return succeeded ? 0 : 1;
+}
@@ -0,0 +1,618 @@
+#include "deflate.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <queue>
+
+static const uint32_t ADLER_BASE = 65521;
+
+// Largest number of bytes summed before the Adler sums must be reduced.
+static const size_t ADLER_RUN = 5552;
+
+static const int WINDOW_SIZE = 32768;
+static const int HASH_BITS = 15;
+static const int MIN_MATCH = 3;
+static const int MAX_MATCH = 258;
+
+// Candidates tried per position; more finds longer matches, slower. The
+// search also stops at the first match of NICE_MATCH bytes.
+static const int MAX_CHAIN = 8;
+static const int NICE_MATCH = 64;
+
+static const int END_OF_BLOCK = 256;
+static const int LITERAL_SYMBOLS = 288;
+static const int DISTANCE_SYMBOLS = 30;
+static const int CODE_LENGTH_SYMBOLS = 19;
+static const int MAX_CODE_BITS = 15;
+static const int MAX_CODE_LENGTH_BITS = 7;
+
+// Order in which the code length code's own lengths are stored.
+static const uint8_t CODE_LENGTH_ORDER[CODE_LENGTH_SYMBOLS] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+static const uint16_t LENGTH_BASE[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t LENGTH_EXTRA[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t DISTANCE_BASE[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t DISTANCE_EXTRA[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+static uint32_t reverseBits(uint32_t _code, int _length)
+{
+    uint32_t reversed = 0;
+    for (int bit = 0; bit < _length; bit++)
+    {
+        reversed = (reversed << 1) | ((_code >> bit) & 1);
+    }
+    return reversed;
+}
+
+// Symbol tables shared by every block: the lit/length symbol and extra
+// bits of every match length, the distance code of every distance, and
+// the fixed Huffman code lengths of RFC 1951 section 3.2.6.
+struct DeflateTables
+{
+    uint16_t length_symbol[MAX_MATCH + 1];
+    uint8_t distance_code[WINDOW_SIZE + 1];
+    uint8_t fixed_literal_lengths[LITERAL_SYMBOLS];
+    uint8_t fixed_distance_lengths[DISTANCE_SYMBOLS];
+
+    DeflateTables()
+    {
+        for (int code = 0; code < 29; code++)
+        {
+            const int last = (code == 28) ? MAX_MATCH : LENGTH_BASE[code] + (1 << LENGTH_EXTRA[code]) - 1;
+            for (int length = LENGTH_BASE[code]; length <= last && length <= MAX_MATCH; length++)
+            {
+                this->length_symbol[length] = 257 + code;
+            }
+        }
+
+        for (int code = 0; code < DISTANCE_SYMBOLS; code++)
+        {
+            const int last = DISTANCE_BASE[code] + (1 << DISTANCE_EXTRA[code]) - 1;
+            for (int distance = DISTANCE_BASE[code]; distance <= last && distance <= WINDOW_SIZE; distance++)
+            {
+                this->distance_code[distance] = code;
+            }
+        }
+
+        for (int symbol = 0; symbol < LITERAL_SYMBOLS; symbol++)
+        {
+            if (symbol < 144)
+                this->fixed_literal_lengths[symbol] = 8;
+            else if (symbol < 256)
+                this->fixed_literal_lengths[symbol] = 9;
+            else if (symbol < 280)
+                this->fixed_literal_lengths[symbol] = 7;
+            else
+                this->fixed_literal_lengths[symbol] = 8;
+        }
+        std::fill(this->fixed_distance_lengths, this->fixed_distance_lengths + DISTANCE_SYMBOLS, 5);
+    }
+};
+
+static const DeflateTables &deflateTables()
+{
+    static const DeflateTables tables;
+    return tables;
+}
+
+// A literal byte when distance is 0, otherwise a match of value bytes.
+struct Token
+{
+    uint16_t value;
+    uint16_t distance;
+};
+
+// Canonical Huffman code of an alphabet: code lengths, and the codes
+// themselves bit reversed for an LSB-first stream.
+struct HuffmanCode
+{
+    std::vector<uint8_t> lengths;
+    std::vector<uint16_t> bits;
+};
+
+// Canonical codes from code lengths, as in RFC 1951 section 3.2.2.
+static HuffmanCode canonicalCode(const uint8_t *_lengths, int _count)
+{
+    HuffmanCode code;
+    code.lengths = std::vector<uint8_t>(_lengths, _lengths + _count);
+    code.bits = std::vector<uint16_t>(_count, 0);
+
+    int length_counts[MAX_CODE_BITS + 1] = {0};
+    for (int symbol = 0; symbol < _count; symbol++)
+    {
+        length_counts[_lengths[symbol]]++;
+    }
+    length_counts[0] = 0;
+
+    int next_code[MAX_CODE_BITS + 2] = {0};
+    int value = 0;
+    for (int bits = 1; bits <= MAX_CODE_BITS; bits++)
+    {
+        value = (value + length_counts[bits - 1]) << 1;
+        next_code[bits] = value;
+    }
+
+    for (int symbol = 0; symbol < _count; symbol++)
+    {
+        const int length = _lengths[symbol];
+        if (length != 0)
+            code.bits[symbol] = reverseBits(next_code[length]++, length);
+    }
+    return code;
+}
+
+// Huffman code lengths for _frequencies, none longer than _max_bits. When
+// the optimal code is too deep, the frequencies are flattened and the code
+// rebuilt until it fits. Symbols that never occur get no code, but at least
+// two symbols always do, so every code is complete.
+static std::vector<uint8_t> huffmanLengths(std::vector<uint32_t> _frequencies, int _max_bits)
+{
+    const int count = _frequencies.size();
+    std::vector<uint8_t> lengths(count, 0);
+
+    int used = 0;
+    for (int symbol = 0; symbol < count && used < 2; symbol++)
+    {
+        used += (_frequencies[symbol] != 0);
+    }
+    for (int symbol = 0; symbol < count && used < 2; symbol++)
+    {
+        if (_frequencies[symbol] == 0)
+        {
+            _frequencies[symbol] = 1;
+            used++;
+        }
+    }
+
+    while (true)
+    {
+        // Nodes 0 to count - 1 are the leaves, the rest are merges.
+        typedef std::pair<uint64_t, int> Node;
+        std::priority_queue<Node, std::vector<Node>, std::greater<Node>> queue;
+        std::vector<int> parent(count, -1);
+
+        for (int symbol = 0; symbol < count; symbol++)
+        {
+            if (_frequencies[symbol] != 0)
+                queue.push(Node(_frequencies[symbol], symbol));
+        }
+
+        while (queue.size() > 1)
+        {
+            Node first = queue.top();
+            queue.pop();
+            Node second = queue.top();
+            queue.pop();
+
+            const int merged = parent.size();
+            parent.push_back(-1);
+            parent[first.second] = merged;
+            parent[second.second] = merged;
+            queue.push(Node(first.first + second.first, merged));
+        }
+
+        // Parents always come after their children, so depths fill in
+        // from the root down.
+        std::vector<int> depth(parent.size(), 0);
+        for (int node = (int)parent.size() - 2; node >= 0; node--)
+        {
+            if (parent[node] >= 0)
+                depth[node] = depth[parent[node]] + 1;
+        }
+
+        int deepest = 0;
+        for (int symbol = 0; symbol < count; symbol++)
+        {
+            lengths[symbol] = (_frequencies[symbol] != 0) ? depth[symbol] : 0;
+            deepest = std::max(deepest, (int)lengths[symbol]);
+        }
+
+        if (deepest <= _max_bits)
+            return lengths;
+
+        for (uint32_t &frequency : _frequencies)
+        {
+            if (frequency != 0)
+                frequency = (frequency >> 1) | 1;
+        }
+    }
+}
+
+// Appends bits to a byte vector, least significant bit first.
+struct BitWriter
+{
+    std::vector<uint8_t> &out;
+    uint64_t bits = 0;
+    int count = 0;
+
+    explicit BitWriter(std::vector<uint8_t> &_out) : out(_out) {}
+
+    // Up to 32 bits at a time.
+    void put(uint32_t _bits, int _length)
+    {
+        this->bits |= (uint64_t)_bits << this->count;
+        this->count += _length;
+        if (this->count >= 32)
+        {
+            uint8_t bytes[4] = {
+                (uint8_t)this->bits, (uint8_t)(this->bits >> 8), (uint8_t)(this->bits >> 16), (uint8_t)(this->bits >> 24)};
+            this->out.insert(this->out.end(), bytes, bytes + 4);
+            this->bits >>= 32;
+            this->count -= 32;
+        }
+    }
+
+    // Pads to a byte boundary and writes out what is left.
+    void align()
+    {
+        while (this->count > 0)
+        {
+            this->out.push_back(this->bits & 0xFF);
+            this->bits >>= 8;
+            this->count -= 8;
+        }
+        this->count = 0;
+        this->bits = 0;
+    }
+};
+
+uint32_t crc32(const uint8_t *_data, size_t _size, uint32_t _crc)
+{
+    static const struct CrcTable
+    {
+        uint32_t entries[256];
+
+        CrcTable()
+        {
+            for (uint32_t n = 0; n < 256; n++)
+            {
+                uint32_t c = n;
+                for (int bit = 0; bit < 8; bit++)
+                {
+                    c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+                }
+                this->entries[n] = c;
+            }
+        }
+    } table;
+
+    uint32_t crc = ~_crc;
+    for (size_t i = 0; i < _size; i++)
+    {
+        crc = table.entries[(crc ^ _data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+uint32_t adler32(const uint8_t *_data, size_t _size, uint32_t _adler)
+{
+    uint32_t a = _adler & 0xFFFF;
+    uint32_t b = _adler >> 16;
+
+    while (_size > 0)
+    {
+        const size_t run = std::min(_size, ADLER_RUN);
+        for (size_t i = 0; i < run; i++)
+        {
+            a += _data[i];
+            b += a;
+        }
+        a %= ADLER_BASE;
+        b %= ADLER_BASE;
+        _data += run;
+        _size -= run;
+    }
+    return (b << 16) | a;
+}
+
+// As zlib's adler32_combine.
+uint32_t adler32Combine(uint32_t _first, uint32_t _second, size_t _second_size)
+{
+    const uint32_t remainder = _second_size % ADLER_BASE;
+    uint32_t a = _first & 0xFFFF;
+    uint32_t b = (uint32_t)(((uint64_t)remainder * a) % ADLER_BASE);
+
+    a += (_second & 0xFFFF) + ADLER_BASE - 1;
+    b += (_first >> 16) + (_second >> 16) + ADLER_BASE - remainder;
+
+    if (a >= ADLER_BASE)
+        a -= ADLER_BASE;
+    if (a >= ADLER_BASE)
+        a -= ADLER_BASE;
+    if (b >= (ADLER_BASE << 1))
+        b -= (ADLER_BASE << 1);
+    if (b >= ADLER_BASE)
+        b -= ADLER_BASE;
+    return (b << 16) | a;
+}
+
+static uint32_t hashAt(const uint8_t *_at)
+{
+    uint32_t key = ((uint32_t)_at[0] << 16) | ((uint32_t)_at[1] << 8) | _at[2];
+    return (key * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Number of leading bytes _a and _b share, up to _max_length, compared
+// eight at a time.
+static int matchLength(const uint8_t *_a, const uint8_t *_b, int _max_length)
+{
+    int length = 0;
+    while (length + 8 <= _max_length)
+    {
+        uint64_t a;
+        uint64_t b;
+        std::memcpy(&a, _a + length, 8);
+        std::memcpy(&b, _b + length, 8);
+        if (a != b)
+            return length + (__builtin_ctzll(a ^ b) >> 3);
+        length += 8;
+    }
+    while (length < _max_length && _a[length] == _b[length])
+    {
+        length++;
+    }
+    return length;
+}
+
+// Greedy LZ77 over _data: at every position, the longest match among the
+// last MAX_CHAIN positions sharing its hash, or a literal.
+static void findMatches(const uint8_t *_data, size_t _size, std::vector<Token> &_tokens)
+{
+    // Most recent position of every hash, and the one before each position
+    // with the same hash, as a chain through the window.
+    std::vector<int64_t> head((size_t)1 << HASH_BITS, -1);
+    std::vector<int64_t> previous(WINDOW_SIZE, -1);
+
+    auto insert = [&](int64_t _position)
+    {
+        uint32_t hash = hashAt(_data + _position);
+        previous[_position & (WINDOW_SIZE - 1)] = head[hash];
+        head[hash] = _position;
+    };
+
+    const int64_t size = _size;
+    int64_t position = 0;
+    while (position < size)
+    {
+        int best_length = 0;
+        int best_distance = 0;
+
+        if (position + MIN_MATCH <= size)
+        {
+            const int max_length = std::min<int64_t>(MAX_MATCH, size - position);
+            const uint8_t *current = _data + position;
+
+            int64_t candidate = head[hashAt(current)];
+            for (int chain = 0; chain < MAX_CHAIN && candidate >= 0 && position - candidate <= WINDOW_SIZE; chain++)
+            {
+                const uint8_t *match = _data + candidate;
+                if (match[best_length] == current[best_length])
+                {
+                    const int length = matchLength(match, current, max_length);
+                    if (length > best_length)
+                    {
+                        best_length = length;
+                        best_distance = position - candidate;
+                        if (length >= NICE_MATCH || length == max_length)
+                            break;
+                    }
+                }
+                candidate = previous[candidate & (WINDOW_SIZE - 1)];
+            }
+
+            insert(position);
+        }
+
+        if (best_length >= MIN_MATCH)
+        {
+            _tokens.push_back(Token{(uint16_t)best_length, (uint16_t)best_distance});
+            for (int64_t skipped = position + 1; skipped < position + best_length && skipped + MIN_MATCH <= size; skipped++)
+            {
+                insert(skipped);
+            }
+            position += best_length;
+        }
+        else
+        {
+            _tokens.push_back(Token{_data[position], 0});
+            position++;
+        }
+    }
+}
+
+// Bits the tokens take with the given code lengths, extra bits aside
+// (they are the same whatever the codes).
+static uint64_t codedBits(const std::vector<uint32_t> &_literal_counts, const uint8_t *_literal_lengths,
+                          const std::vector<uint32_t> &_distance_counts, const uint8_t *_distance_lengths)
+{
+    uint64_t bits = 0;
+    for (size_t symbol = 0; symbol < _literal_counts.size(); symbol++)
+    {
+        bits += (uint64_t)_literal_counts[symbol] * _literal_lengths[symbol];
+    }
+    for (size_t symbol = 0; symbol < _distance_counts.size(); symbol++)
+    {
+        bits += (uint64_t)_distance_counts[symbol] * _distance_lengths[symbol];
+    }
+    return bits;
+}
+
+// Run-length codes of the literal and distance code lengths: 16 repeats
+// the previous length 3-6 times, 17 and 18 give 3-10 and 11-138 zeros.
+// Each entry is a symbol and its extra bits value.
+static std::vector<std::pair<int, int>> codeLengthRuns(const std::vector<uint8_t> &_lengths)
+{
+    std::vector<std::pair<int, int>> runs;
+    size_t i = 0;
+    while (i < _lengths.size())
+    {
+        const int length = _lengths[i];
+        size_t run = 1;
+        while (i + run < _lengths.size() && _lengths[i + run] == length)
+        {
+            run++;
+        }
+
+        if (length == 0 && run >= 11)
+        {
+            run = std::min<size_t>(run, 138);
+            runs.push_back(std::make_pair(18, (int)run - 11));
+        }
+        else if (length == 0 && run >= 3)
+        {
+            runs.push_back(std::make_pair(17, (int)run - 3));
+        }
+        else if (length != 0 && run >= 4)
+        {
+            run = std::min<size_t>(run, 7);
+            runs.push_back(std::make_pair(length, 0));
+            runs.push_back(std::make_pair(16, (int)run - 4));
+        }
+        else
+        {
+            run = 1;
+            runs.push_back(std::make_pair(length, 0));
+        }
+        i += run;
+    }
+    return runs;
+}
+
+static const uint8_t CODE_LENGTH_EXTRA[CODE_LENGTH_SYMBOLS] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 3, 7};
+
+void deflateBlock(const uint8_t *_data, size_t _size, bool _final, std::vector<uint8_t> &_out)
+{
+    const DeflateTables &tables = deflateTables();
+
+    std::vector<Token> tokens;
+    findMatches(_data, _size, tokens);
+
+    std::vector<uint32_t> literal_counts(LITERAL_SYMBOLS, 0);
+    std::vector<uint32_t> distance_counts(DISTANCE_SYMBOLS, 0);
+    for (const Token &token : tokens)
+    {
+        if (token.distance == 0)
+        {
+            literal_counts[token.value]++;
+        }
+        else
+        {
+            literal_counts[tables.length_symbol[token.value]]++;
+            distance_counts[tables.distance_code[token.distance]]++;
+        }
+    }
+    literal_counts[END_OF_BLOCK]++;
+
+    // Dynamic codes over the 286 lit/length symbols that can occur.
+    std::vector<uint32_t> dynamic_counts(literal_counts.begin(), literal_counts.begin() + 286);
+    std::vector<uint8_t> literal_lengths = huffmanLengths(dynamic_counts, MAX_CODE_BITS);
+    std::vector<uint8_t> distance_lengths = huffmanLengths(distance_counts, MAX_CODE_BITS);
+    literal_lengths.resize(LITERAL_SYMBOLS, 0);
+
+    int literal_count = 286;
+    while (literal_count > 257 && literal_lengths[literal_count - 1] == 0)
+    {
+        literal_count--;
+    }
+    int distance_count = DISTANCE_SYMBOLS;
+    while (distance_count > 1 && distance_lengths[distance_count - 1] == 0)
+    {
+        distance_count--;
+    }
+
+    std::vector<uint8_t> all_lengths(literal_lengths.begin(), literal_lengths.begin() + literal_count);
+    all_lengths.insert(all_lengths.end(), distance_lengths.begin(), distance_lengths.begin() + distance_count);
+    std::vector<std::pair<int, int>> runs = codeLengthRuns(all_lengths);
+
+    std::vector<uint32_t> run_counts(CODE_LENGTH_SYMBOLS, 0);
+    for (const auto &run : runs)
+    {
+        run_counts[run.first]++;
+    }
+    std::vector<uint8_t> run_lengths = huffmanLengths(run_counts, MAX_CODE_LENGTH_BITS);
+
+    int order_count = CODE_LENGTH_SYMBOLS;
+    while (order_count > 4 && run_lengths[CODE_LENGTH_ORDER[order_count - 1]] == 0)
+    {
+        order_count--;
+    }
+
+    // Dynamic codes pay for their header; take whichever block is smaller.
+    uint64_t dynamic_bits = 5 + 5 + 4 + (3 * order_count) +
+                            codedBits(literal_counts, literal_lengths.data(), distance_counts, distance_lengths.data());
+    for (const auto &run : runs)
+    {
+        dynamic_bits += run_lengths[run.first] + CODE_LENGTH_EXTRA[run.first];
+    }
+    const uint64_t fixed_bits = codedBits(literal_counts, tables.fixed_literal_lengths, distance_counts, tables.fixed_distance_lengths);
+    const bool dynamic = dynamic_bits < fixed_bits;
+
+    HuffmanCode literal_code = dynamic ? canonicalCode(literal_lengths.data(), LITERAL_SYMBOLS)
+                                       : canonicalCode(tables.fixed_literal_lengths, LITERAL_SYMBOLS);
+    HuffmanCode distance_code = dynamic ? canonicalCode(distance_lengths.data(), DISTANCE_SYMBOLS)
+                                        : canonicalCode(tables.fixed_distance_lengths, DISTANCE_SYMBOLS);
+
+    BitWriter writer(_out);
+    writer.put(_final ? 1 : 0, 1);
+    writer.put(dynamic ? 2 : 1, 2);
+
+    if (dynamic)
+    {
+        HuffmanCode run_code = canonicalCode(run_lengths.data(), CODE_LENGTH_SYMBOLS);
+
+        writer.put(literal_count - 257, 5);
+        writer.put(distance_count - 1, 5);
+        writer.put(order_count - 4, 4);
+        for (int i = 0; i < order_count; i++)
+        {
+            writer.put(run_lengths[CODE_LENGTH_ORDER[i]], 3);
+        }
+        for (const auto &run : runs)
+        {
+            writer.put(run_code.bits[run.first], run_code.lengths[run.first]);
+            writer.put(run.second, CODE_LENGTH_EXTRA[run.first]);
+        }
+    }
+
+    for (const Token &token : tokens)
+    {
+        if (token.distance == 0)
+        {
+            writer.put(literal_code.bits[token.value], literal_code.lengths[token.value]);
+            continue;
+        }
+
+        const int symbol = tables.length_symbol[token.value];
+        const int length_code = symbol - 257;
+        writer.put(literal_code.bits[symbol], literal_code.lengths[symbol]);
+        writer.put(token.value - LENGTH_BASE[length_code], LENGTH_EXTRA[length_code]);
+
+        const int code = tables.distance_code[token.distance];
+        writer.put(distance_code.bits[code], distance_code.lengths[code]);
+        writer.put(token.distance - DISTANCE_BASE[code], DISTANCE_EXTRA[code]);
+    }
+
+    writer.put(literal_code.bits[END_OF_BLOCK], literal_code.lengths[END_OF_BLOCK]);
+
+    if (!_final)
+    {
+        // Sync flush: an empty stored block, whose length fields start on
+        // a byte boundary.
+        writer.put(0, 1);
+        writer.put(0, 2);
+        writer.align();
+        writer.put(0x0000, 16);
+        writer.put(0xFFFF, 16);
+    }
+    writer.align();
+}
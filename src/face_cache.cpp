@@ -0,0 +1,214 @@
+#include "face_cache.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <utility>
+
+// Faces are cached in blocks of this many, one pool task per block.
+static const int FACES_PER_CACHE_BLOCK = 8192;
+
+// One face as it is being read from the mesh, before it is stored.
+struct CachedFace
+{
+    int u[3];
+    int v[3];
+    int m[3];
+};
+
+static int vertexIndex(const Mesh &_mesh, int _face, int _corner)
+{
+    if (_mesh.indices)
+        return _mesh.indices[(_face * 3) + _corner];
+    return (_face * 3) + _corner;
+}
+
+// Reads the texture coordinates of face _face into pixel space. Returns
+// false if the face should be rejected.
+static bool readFaceCoordinates(const Mesh &_mesh, int _face, int _width, int _height, CachedFace &_out)
+{
+    for (int corner = 0; corner < 3; corner++)
+    {
+        const float *texcoord = _mesh.texcoords + (vertexIndex(_mesh, _face, corner) * 2);
+        float u = texcoord[0] * _width;
+        float v = texcoord[1] * _height;
+
+        if (!(u >= 0 && u < _width && v >= 0 && v < _height))
+            return false;
+
+        _out.u[corner] = (int)u;
+        _out.v[corner] = (int)v;
+    }
+
+    // Twice the signed area; zero area faces cover no pixel.
+    long long area2 = ((long long)(_out.u[1] - _out.u[0]) * (_out.v[2] - _out.v[0])) -
+                      ((long long)(_out.u[2] - _out.u[0]) * (_out.v[1] - _out.v[0]));
+    return area2 != 0;
+}
+
+static void readFaceMagnitudes(
+    const Mesh &_mesh,
+    const float *_distances,
+    int _face,
+    float _min_distance,
+    float _distance_range,
+    int _magnitude_max,
+    CachedFace &_out)
+{
+    for (int corner = 0; corner < 3; corner++)
+    {
+        float distance = _distances[vertexIndex(_mesh, _face, corner)];
+        float real_magnitude = (_distance_range > 0) ? (distance - _min_distance) / _distance_range : 0.0f;
+        float color_magnitude = _magnitude_max * real_magnitude;
+
+        _out.m[corner] = std::min(std::max((int)color_magnitude, 0), _magnitude_max);
+    }
+}
+
+// Sorts the corners by ascending v, keeping the original order of ties.
+static void orderFace(CachedFace &_face)
+{
+    auto swap_corners = [&_face](int _a, int _b)
+    {
+        std::swap(_face.u[_a], _face.u[_b]);
+        std::swap(_face.v[_a], _face.v[_b]);
+        std::swap(_face.m[_a], _face.m[_b]);
+    };
+
+    if (_face.v[0] > _face.v[1])
+        swap_corners(0, 1);
+    if (_face.v[1] > _face.v[2])
+        swap_corners(1, 2);
+    if (_face.v[0] > _face.v[1])
+        swap_corners(0, 1);
+}
+
+void FaceCache::resize(int _faces_count)
+{
+    for (std::vector<int> *array : {&u0, &v0, &u1, &v1, &u2, &v2, &m0, &m1, &m2})
+    {
+        array->resize(_faces_count);
+        array->shrink_to_fit();
+    }
+}
+
+void FaceCache::build(
+    const Model &_model,
+    const VertexMagnitudes &_magnitudes,
+    int _width,
+    int _height,
+    float _min_distance,
+    float _distance_range,
+    int _magnitude_max)
+{
+    // Blocks of every mesh go to the pool together, as in
+    // VertexMagnitudes::build. Block order is mesh order, then face order,
+    // which is the order the faces end up in.
+    struct FaceBlock
+    {
+        int mesh;
+        int begin;
+        int end;
+    };
+
+    std::vector<FaceBlock> blocks;
+    int faces_count = 0;
+
+    for (int mesh = 0; mesh < _model.meshCount; mesh++)
+    {
+        const Mesh &raster_mesh = _model.meshes[mesh];
+        const int mesh_faces = (raster_mesh.texcoords && raster_mesh.vertices) ? raster_mesh.triangleCount : 0;
+
+        for (int begin = 0; begin < mesh_faces; begin += FACES_PER_CACHE_BLOCK)
+        {
+            blocks.push_back(FaceBlock{mesh, begin, std::min(mesh_faces, begin + FACES_PER_CACHE_BLOCK)});
+        }
+        faces_count += mesh_faces;
+    }
+
+    const int blocks_count = blocks.size();
+
+    // First pass: count the faces each block keeps.
+    std::vector<int> block_offsets(blocks_count + 1, 0);
+
+    TaskGroup counters;
+    for (int block = 0; block < blocks_count; block++)
+    {
+        counters.run([&, block]()
+        {
+            const Mesh &raster_mesh = _model.meshes[blocks[block].mesh];
+            CachedFace face;
+            for (int face_index = blocks[block].begin; face_index < blocks[block].end; face_index++)
+            {
+                if (readFaceCoordinates(raster_mesh, face_index, _width, _height, face))
+                    block_offsets[block + 1]++;
+            }
+        });
+    }
+    counters.wait();
+
+    for (int block = 0; block < blocks_count; block++)
+    {
+        block_offsets[block + 1] += block_offsets[block];
+    }
+
+    resize(block_offsets[blocks_count]);
+    this->rejected_count = faces_count - size();
+
+    // Second pass: every block fills its own slice of the arrays.
+    TaskGroup writers;
+    for (int block = 0; block < blocks_count; block++)
+    {
+        writers.run([&, block]()
+        {
+            const Mesh &raster_mesh = _model.meshes[blocks[block].mesh];
+            const float *distances = _magnitudes.distances.get() + _magnitudes.mesh_offsets[blocks[block].mesh];
+            int slot = block_offsets[block];
+            CachedFace face;
+            for (int face_index = blocks[block].begin; face_index < blocks[block].end; face_index++)
+            {
+                if (!readFaceCoordinates(raster_mesh, face_index, _width, _height, face))
+                    continue;
+
+                readFaceMagnitudes(raster_mesh, distances, face_index, _min_distance, _distance_range, _magnitude_max, face);
+                orderFace(face);
+
+                u0[slot] = face.u[0];
+                v0[slot] = face.v[0];
+                m0[slot] = face.m[0];
+                u1[slot] = face.u[1];
+                v1[slot] = face.v[1];
+                m1[slot] = face.m[1];
+                u2[slot] = face.u[2];
+                v2[slot] = face.v[2];
+                m2[slot] = face.m[2];
+                slot++;
+            }
+        });
+    }
+    writers.wait();
+}
+
+int FaceCache::size()
+{
+    return this->u0.size();
+}
+
+bool FaceCache::empty()
+{
+    return this->u0.empty();
+}
+
+int FaceCache::getRejectedCount()
+{
+    return this->rejected_count;
+}
+
+// Under the fill rule of rasterizeTriangle, covered pixels never leave the
+// box spanned by the corners.
+FaceBounds FaceCache::getBounds(int _face)
+{
+    return FaceBounds{
+        std::min({u0[_face], u1[_face], u2[_face]}),
+        v0[_face],
+        std::max({u0[_face], u1[_face], u2[_face]}) + 1,
+        v2[_face] + 1};
+}
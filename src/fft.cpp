@@ -0,0 +1,151 @@
+#include "fft.h"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+static const double TWO_PI = 6.283185307179586;
+
+Fft::Fft(int _size)
+{
+    this->size = _size;
+
+    int bits = 0;
+    while ((1 << bits) < _size)
+    {
+        bits++;
+    }
+
+    this->bit_reversed = std::vector<int>(_size);
+    for (int i = 0; i < _size; i++)
+    {
+        int reversed = 0;
+        for (int bit = 0; bit < bits; bit++)
+        {
+            reversed |= ((i >> bit) & 1) << (bits - 1 - bit);
+        }
+        this->bit_reversed[i] = reversed;
+    }
+
+    this->twiddle_cos = std::vector<float>(std::max(_size - 1, 1));
+    this->twiddle_sin = std::vector<float>(std::max(_size - 1, 1));
+    for (int half_width = 1; half_width < _size; half_width *= 2)
+    {
+        for (int j = 0; j < half_width; j++)
+        {
+            double angle = (TWO_PI * j) / (2 * half_width);
+            this->twiddle_cos[half_width - 1 + j] = std::cos(angle);
+            this->twiddle_sin[half_width - 1 + j] = std::sin(angle);
+        }
+    }
+}
+
+int Fft::getSize() const
+{
+    return this->size;
+}
+
+void Fft::inverse(float *_real, float *_imag) const
+{
+    for (int i = 0; i < this->size; i++)
+    {
+        int j = this->bit_reversed[i];
+        if (i < j)
+        {
+            std::swap(_real[i], _real[j]);
+            std::swap(_imag[i], _imag[j]);
+        }
+    }
+
+    for (int half_width = 1; half_width < this->size; half_width *= 2)
+    {
+        const float *w_cos = this->twiddle_cos.data() + half_width - 1;
+        const float *w_sin = this->twiddle_sin.data() + half_width - 1;
+
+        for (int block = 0; block < this->size; block += 2 * half_width)
+        {
+            float *top_real = _real + block;
+            float *top_imag = _imag + block;
+            float *bottom_real = top_real + half_width;
+            float *bottom_imag = top_imag + half_width;
+
+            for (int j = 0; j < half_width; j++)
+            {
+                float real = (bottom_real[j] * w_cos[j]) - (bottom_imag[j] * w_sin[j]);
+                float imag = (bottom_real[j] * w_sin[j]) + (bottom_imag[j] * w_cos[j]);
+
+                bottom_real[j] = top_real[j] - real;
+                bottom_imag[j] = top_imag[j] - imag;
+                top_real[j] = top_real[j] + real;
+                top_imag[j] = top_imag[j] + imag;
+            }
+        }
+    }
+}
+
+RealFft::RealFft(int _size) : half(_size / 2)
+{
+    this->size = _size;
+
+    this->split_cos = std::vector<float>(_size / 2);
+    this->split_sin = std::vector<float>(_size / 2);
+    for (int k = 0; k < _size / 2; k++)
+    {
+        double angle = (TWO_PI * k) / _size;
+        this->split_cos[k] = std::cos(angle);
+        this->split_sin[k] = std::sin(angle);
+    }
+}
+
+int RealFft::getSize() const
+{
+    return this->size;
+}
+
+// The even and odd samples of the signal are packed as the real and
+// imaginary parts of one half size complex signal z. Its spectrum is
+//
+//     Z[k] = (X[k] + conj(X[M - k])) + i * (X[k] - conj(X[M - k])) * e^(2 pi i k / N)
+//
+// with N = size and M = N / 2, scaled so the half size inverse comes out at
+// the same scale as a full size one.
+void RealFft::inverse(float *_real, float *_imag, float *_out) const
+{
+    const int half_size = this->size / 2;
+
+    auto splitBin = [this, _real, _imag](int _k, float _real_k, float _imag_k, float _real_mirror, float _imag_mirror)
+    {
+        float sum_real = _real_k + _real_mirror;
+        float sum_imag = _imag_k - _imag_mirror;
+        float diff_real = _real_k - _real_mirror;
+        float diff_imag = _imag_k + _imag_mirror;
+
+        float rotated_real = (diff_real * this->split_cos[_k]) - (diff_imag * this->split_sin[_k]);
+        float rotated_imag = (diff_real * this->split_sin[_k]) + (diff_imag * this->split_cos[_k]);
+
+        _real[_k] = sum_real - rotated_imag;
+        _imag[_k] = sum_imag + rotated_real;
+    };
+
+    // Bins k and M - k depend on each other, so they are split in pairs.
+    splitBin(0, _real[0], _imag[0], _real[half_size], _imag[half_size]);
+    for (int k = 1; k <= half_size / 2; k++)
+    {
+        const int mirror = half_size - k;
+        float real_k = _real[k];
+        float imag_k = _imag[k];
+        float real_mirror = _real[mirror];
+        float imag_mirror = _imag[mirror];
+
+        splitBin(k, real_k, imag_k, real_mirror, imag_mirror);
+        if (mirror != k)
+            splitBin(mirror, real_mirror, imag_mirror, real_k, imag_k);
+    }
+
+    this->half.inverse(_real, _imag);
+
+    for (int m = 0; m < half_size; m++)
+    {
+        _out[2 * m] = _real[m];
+        _out[(2 * m) + 1] = _imag[m];
+    }
+}
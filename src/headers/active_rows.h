@@ -0,0 +1,48 @@
+#pragma once
+
+#include "spectrogram.h"
+#include <cstdint>
+#include <vector>
+
+// How much of a spectrogram is lit, as reported by ActiveRows.
+struct SparsityStats
+{
+    int64_t cells;
+    int64_t active_cells;
+    int empty_columns;
+    int max_column_rows;
+    double mean_column_rows;
+};
+
+// Index of the non-zero rows of every spectrogram column, so synthesis only
+// visits rows that make a sound.
+//
+// CSR layout: the rows of column c are column_rows[column_offsets[c]] up to
+// column_rows[column_offsets[c + 1]], in ascending order. Entry i of the
+// index also numbers any per-entry data kept alongside it, such as the
+// synthesis engines' amplitudes.
+class ActiveRows
+{
+public:
+    // Rebuilds the index from _spectrogram, in parallel on the ThreadPool.
+    void build(const Spectrogram &_spectrogram);
+
+    bool empty();
+    int getRowsCount() const;
+    int getColumnsCount() const;
+    int64_t getEntriesCount() const;
+
+    int64_t columnOffset(int _column) const;
+    int columnRowsCount(int _column) const;
+    const int *columnRowsBegin(int _column) const;
+    const int *columnRowsEnd(int _column) const;
+
+    SparsityStats getStats() const;
+
+private:
+    int rows_count = 0;
+    int columns_count = 0;
+
+    std::vector<int64_t> column_offsets;
+    std::vector<int> column_rows;
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+
+// Maps a (column, row) position of a spectrogram buffer to its index.
+//
+// Any width works with DynamicLayout; the common power-of-two widths get a
+// PowerOfTwoLayout, where the width is a compile time constant and indexing
+// is a shift and an or instead of a multiply. Code that indexes per pixel or
+// per sample is written once as a template over the layout and instantiated
+// for each of them through withBufferLayout.
+struct DynamicLayout
+{
+    int width;
+
+    explicit DynamicLayout(int _width) : width(_width) {}
+
+    int64_t index(int _x, int _y) const
+    {
+        return ((int64_t)_y * width) + _x;
+    }
+
+    int column(int64_t _index) const
+    {
+        return _index % width;
+    }
+
+    int row(int64_t _index) const
+    {
+        return _index / width;
+    }
+};
+
+template <int WIDTH_LOG2>
+struct PowerOfTwoLayout
+{
+    static constexpr int width = 1 << WIDTH_LOG2;
+
+    int64_t index(int _x, int _y) const
+    {
+        return ((int64_t)_y << WIDTH_LOG2) | _x;
+    }
+
+    int column(int64_t _index) const
+    {
+        return _index & (width - 1);
+    }
+
+    int row(int64_t _index) const
+    {
+        return _index >> WIDTH_LOG2;
+    }
+};
+
+// Calls _function with the fastest layout for a buffer _width wide.
+template <typename Function>
+void withBufferLayout(int _width, Function _function)
+{
+    switch (_width)
+    {
+    case 256:
+        _function(PowerOfTwoLayout<8>());
+        break;
+    case 512:
+        _function(PowerOfTwoLayout<9>());
+        break;
+    case 1024:
+        _function(PowerOfTwoLayout<10>());
+        break;
+    case 2048:
+        _function(PowerOfTwoLayout<11>());
+        break;
+    case 4096:
+        _function(PowerOfTwoLayout<12>());
+        break;
+    case 8192:
+        _function(PowerOfTwoLayout<13>());
+        break;
+    default:
+        _function(DynamicLayout(_width));
+        break;
+    }
+}
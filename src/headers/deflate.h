@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Checksums of the zlib and PNG containers. Both can be continued over
+// more data by passing the previous result back in.
+uint32_t crc32(const uint8_t *_data, size_t _size, uint32_t _crc = 0);
+uint32_t adler32(const uint8_t *_data, size_t _size, uint32_t _adler = 1);
+
+// Adler-32 of two pieces joined together, from the Adler-32 of each and
+// the size of the second, so pieces can be summed in parallel.
+uint32_t adler32Combine(uint32_t _first, uint32_t _second, size_t _second_size);
+
+// Appends _data to _out as raw DEFLATE (RFC 1951): one block of greedy
+// LZ77 matches over a 32 KiB window, Huffman coded with codes built for
+// the block, or with the fixed codes when those come out smaller.
+//
+// Only _data is used as history, so independent pieces can be compressed
+// in parallel and joined. The output always ends on a byte boundary: with
+// the final block flag when _final is set, otherwise followed by an empty
+// stored block (a sync flush) so the next piece can be appended directly.
+void deflateBlock(const uint8_t *_data, size_t _size, bool _final, std::vector<uint8_t> &_out);
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "raylib.h"
+#include "tile_bins.h"
+#include "vertex_magnitudes.h"
+#include <vector>
+
+// Compact structure-of-arrays copy of a model's faces in buffer space, built
+// once per model and streamed by the rasterizer.
+//
+// Corner 0 is the top (lowest v), corner 2 the bottom (highest v); u/v are
+// pixel coordinates and m the magnitude of each corner, on the integer
+// scale of the buffer's element type (see SampleTraits). Faces that
+// would write nothing (zero area) or reach outside the buffer are dropped
+// while building. The remaining faces of all meshes are stored one mesh
+// after the other, each in its own face order, so later meshes are drawn
+// over earlier ones.
+class FaceCache
+{
+public:
+    std::vector<int> u0, v0, u1, v1, u2, v2;
+    std::vector<int> m0, m1, m2;
+
+    // Rebuilds the cache from every mesh of _model for a _width x _height
+    // buffer, mapping the vertex distances from the origin (see
+    // VertexMagnitudes) onto 0-_magnitude_max with the given range.
+    void build(
+        const Model &_model,
+        const VertexMagnitudes &_magnitudes,
+        int _width,
+        int _height,
+        float _min_distance,
+        float _distance_range,
+        int _magnitude_max);
+
+    int size();
+    bool empty();
+    int getRejectedCount();
+
+    // Pixel box of face _face, as used for tile binning.
+    FaceBounds getBounds(int _face);
+
+private:
+    int rejected_count = 0;
+
+    void resize(int _faces_count);
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+
+// Radix-2 complex FFT of one fixed power-of-two size.
+//
+// Data is split into separate real and imaginary arrays, and every stage has
+// its own contiguous twiddle table, so each butterfly pass is a plain loop
+// over consecutive floats that the compiler can vectorize.
+class Fft
+{
+public:
+    explicit Fft(int _size);
+
+    int getSize() const;
+
+    // In place, unscaled inverse transform:
+    // x[n] = sum over k of X[k] * e^(2 pi i k n / size).
+    void inverse(float *_real, float *_imag) const;
+
+private:
+    int size;
+    std::vector<int> bit_reversed;
+
+    // Stage with half width h has its h twiddles at offset h - 1.
+    std::vector<float> twiddle_cos;
+    std::vector<float> twiddle_sin;
+};
+
+// Inverse FFT of a real signal of power-of-two size, computed as a complex
+// FFT of half that size.
+class RealFft
+{
+public:
+    explicit RealFft(int _size);
+
+    int getSize() const;
+
+    // Unscaled inverse transform of a real signal, given bins 0 to size / 2
+    // of its spectrum (size / 2 + 1 values each; the other half mirrors
+    // them). Writes size samples to _out. _real and _imag are clobbered.
+    void inverse(float *_real, float *_imag, float *_out) const;
+
+private:
+    int size;
+    Fft half;
+
+    // e^(2 pi i k / size) for k < size / 2.
+    std::vector<float> split_cos;
+    std::vector<float> split_sin;
+};
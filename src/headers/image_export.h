@@ -0,0 +1,62 @@
+#pragma once
+
+#include "spectrogram.h"
+#include "job_queue.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// File format of an exported spectrogram image, one pixel per cell, rows
+// top to bottom.
+enum ImageFileFormat
+{
+    // Plain text P2, at maxval 255 for uint8 buffers and 65535 otherwise.
+    IMAGE_PGM_ASCII = 0,
+    // Binary P5 at maxval 255, one byte per pixel.
+    IMAGE_PGM_8,
+    // Binary P5 at maxval 65535, two big endian bytes per pixel.
+    IMAGE_PGM_16,
+    // Greyscale PNG at 8 and 16 bits per pixel.
+    IMAGE_PNG_8,
+    IMAGE_PNG_16,
+    // 8 bit RGB PNG, magnitudes mapped through a dark-to-bright heat
+    // colormap.
+    IMAGE_PNG_COLORMAP,
+    // Native spectrogram file: the buffer exactly as stored, any element
+    // type, for reading back with readImage.
+    IMAGE_SPECTROGRAM,
+};
+
+// Native spectrogram files start with these 8 bytes, then the version,
+// width, height and SpectrogramFormat as little endian uint32, then the
+// elements, row-major and little endian.
+#define SPECTROGRAM_FILE_MAGIC "MUSESPEC"
+#define SPECTROGRAM_FILE_VERSION 1
+#define SPECTROGRAM_FILE_HEADER_SIZE 24
+
+// The binary format that keeps all of _format's precision.
+ImageFileFormat getBinaryImageFormat(SpectrogramFormat _format);
+
+// File name extension for _format, dot included. P2 keeps the historic
+// ".ppm"; binary PGM files are ".pgm", PNG ".png" and native files
+// ".spec".
+const char *getImageExtension(ImageFileFormat _format);
+
+// Encodes the whole image file, header included, into one buffer. Bands of
+// rows are converted in parallel on the thread pool: binary bands straight
+// into their place in the buffer, text bands apart and then copied in.
+//
+// PNG bands are filtered and compressed independently (see deflateBlock)
+// and each becomes its own IDAT chunk, so together they form one zlib
+// stream; its Adler-32 is combined from the bands' and stored last.
+//
+// Encoded rows are counted into _progress. Once it is cancelled, bands not
+// yet started are skipped and the result is empty.
+std::vector<uint8_t> encodeImage(const Spectrogram &_spectrogram, ImageFileFormat _format);
+std::vector<uint8_t> encodeImage(const Spectrogram &_spectrogram, ImageFileFormat _format, JobProgress &_progress);
+
+// Encodes _spectrogram and writes it to _path in a single write. False if
+// the file could not be written, or, leaving _path alone, if _progress was
+// cancelled.
+bool writeImage(const std::string &_path, const Spectrogram &_spectrogram, ImageFileFormat _format);
+bool writeImage(const std::string &_path, const Spectrogram &_spectrogram, ImageFileFormat _format, JobProgress &_progress);
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "spectrogram.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Reads back a spectrogram written by writeImage, recognised by its
+// contents rather than its name:
+//
+//  - native spectrogram files, in their own element type,
+//  - P5 at up to 16 bits and P2 (PGM/"ppm") images, as uint8 at maxval
+//    255 or below and uint16 above it, values rescaled to the full range
+//    when maxval is anything else.
+//
+// On failure _out is left untouched.
+bool decodeImage(const uint8_t *_data, size_t _size, Spectrogram &_out);
+
+// Maps the file at _path (see MappedFile) and decodes it. False if it
+// cannot be read or is not a spectrogram image.
+bool readImage(const std::string &_path, Spectrogram &_out);
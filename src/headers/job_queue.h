@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// How far a job has got, and whether it has been asked to stop, shared
+// between the job and the threads watching it.
+//
+// Jobs say how much work they have with start and count it off with
+// advance, in whatever unit suits them (faces, samples). Cancellation is
+// cooperative: jobs check isCancelled between pieces of work and return
+// early, leaving things as they would be had they never started.
+class JobProgress
+{
+public:
+    JobProgress();
+
+    void start(int64_t _total);
+    void advance(int64_t _done);
+
+    int64_t getDone() const;
+    int64_t getTotal() const;
+
+    // Done as 0.0-1.0, 0.0 until the job has started.
+    double getFraction() const;
+
+    void cancel();
+    bool isCancelled() const;
+
+private:
+    std::atomic<int64_t> done;
+    std::atomic<int64_t> total;
+    std::atomic<bool> cancelled;
+};
+
+// Runs long jobs (rasterizing, exporting) one after the other on a thread
+// of its own, so the UI thread keeps drawing while they run. Jobs still
+// spread their own work over the ThreadPool.
+//
+// Every job belongs to an owner, the muse it works on. Completion
+// callbacks are run by update, on the UI thread, never on the job thread.
+class JobQueue
+{
+public:
+    // Does the work, returning false if it failed.
+    typedef std::function<bool(JobProgress &)> Work;
+    // Told whether the work succeeded.
+    typedef std::function<void(bool)> Done;
+
+    JobQueue();
+    ~JobQueue();
+
+    void submit(size_t _owner, std::string _label, Work _work, Done _done);
+
+    // Drops _owner's queued jobs and cancels its running one, waiting until
+    // it has returned. Their completion callbacks are never run, so the
+    // owner can go away right after.
+    void cancel(size_t _owner);
+    void cancelAll();
+
+    // True while _owner has a job queued or running.
+    bool isBusy(size_t _owner);
+
+    // Label and progress fraction of the running job. False when idle.
+    bool getStatus(std::string &_label, double &_fraction);
+
+    // Runs the completion callbacks of finished jobs. Call once per frame.
+    void update();
+
+private:
+    struct Job
+    {
+        size_t owner;
+        std::string label;
+        Work work;
+        Done done;
+        JobProgress progress;
+        bool succeeded;
+    };
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<std::shared_ptr<Job>> queued;
+    std::shared_ptr<Job> running;
+    std::vector<std::shared_ptr<Job>> finished;
+    bool stopping;
+
+    void workerLoop();
+    void cancelWhere(std::function<bool(const Job &)> _matches);
+
+    // Disallow copy
+    JobQueue(const JobQueue &) = delete;
+    JobQueue &operator=(const JobQueue &) = delete;
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Read-only view of a whole file. On POSIX systems the file is memory
+// mapped, so pages are only read in as the parser reaches them and large
+// files are never copied; elsewhere it is read into memory.
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    // False if the file cannot be opened or read.
+    bool open(const std::string &_path);
+    void close();
+
+    const uint8_t *data() const;
+    size_t size() const;
+
+private:
+    const uint8_t *bytes;
+    size_t length;
+    bool mapped;
+    std::vector<uint8_t> contents;
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "raylib.h"
+#include "mapped_file.h"
+#include "vertex_magnitudes.h"
+#include "job_queue.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Mesh cache files hold what rasterizing a model needs, ready to map: a
+// header, then a table of mesh sizes, then the vertex positions, texture
+// coordinates and distances from the origin (see VertexMagnitudes) of all
+// meshes back to back, each array 64 byte aligned. Everything is little
+// endian.
+#define MESH_CACHE_MAGIC "MUSEMESH"
+#define MESH_CACHE_VERSION 1
+#define MESH_CACHE_HEADER_SIZE 64
+#define MESH_CACHE_ALIGNMENT 64
+
+// Hash of the contents of the file at _path, computed in parallel over a
+// mapped view. Progress is counted in bytes. False if it cannot be read or
+// _progress is cancelled.
+bool hashFile(const std::string &_path, uint64_t &_hash, JobProgress &_progress);
+
+// Where the cache of the OBJ file at _obj_path with contents hash _hash
+// lives: MUSER_MESH_CACHE_DIR/<hash>.musemesh when that is set, otherwise
+// <obj file>.musemesh next to it.
+std::string getMeshCachePath(const std::string &_obj_path, uint64_t _hash);
+
+// A mesh cache file mapped into memory. The meshes point straight into the
+// mapping, so opening costs no parsing and no copying, and processes
+// loading the same cache share its pages.
+//
+// Always owned by a shared_ptr (see openMeshCache), so the magnitudes it
+// hands out can keep it open.
+class MeshCache : public std::enable_shared_from_this<MeshCache>
+{
+public:
+    MeshCache();
+
+    // False if there is no cache at _path, or it is of another version or
+    // made from other contents than _source_hash.
+    bool open(const std::string &_path, uint64_t _source_hash);
+
+    // Writes the cache of _model and its _magnitudes, made from contents
+    // with hash _source_hash. Written aside then renamed into place, so
+    // readers never see half a file; false, writing nothing, if _progress
+    // is cancelled.
+    static bool write(const std::string &_path, uint64_t _source_hash, const Model &_model, const VertexMagnitudes &_magnitudes, JobProgress &_progress);
+
+    // A model over the mapped arrays, valid as long as this cache: it has
+    // no materials and is never uploaded, so it can be rasterized, not
+    // drawn.
+    Model getModel();
+
+    // Copies the meshes into arrays of their own, as uploading and
+    // UnloadModel expect.
+    void copyMeshes(std::vector<Mesh> &_meshes);
+
+    // Points _magnitudes at the mapped distances, without copying them;
+    // they hold a reference to this cache.
+    void getMagnitudes(VertexMagnitudes &_magnitudes);
+
+private:
+    MappedFile file;
+    std::vector<Mesh> meshes;
+    std::vector<int> mesh_offsets;
+    const float *distances;
+    float min_distance;
+    float max_distance;
+
+    // Disallow copy
+    MeshCache(const MeshCache &) = delete;
+    MeshCache &operator=(const MeshCache &) = delete;
+};
+
+// Opens the cache of the OBJ file at _obj_path, first reading the OBJ (see
+// loadObjModel) and writing the cache when there is no valid one. Null if
+// the OBJ cannot be read, the cache cannot be written or _progress is
+// cancelled.
+std::shared_ptr<MeshCache> openMeshCache(const std::string &_obj_path, JobProgress &_progress);
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "raylib.h"
+#include "job_queue.h"
+#include <string>
+#include <vector>
+
+// Loads a model and its texture in two halves, so the UI thread never
+// waits for a whole file:
+//
+// 1. parse reads the OBJ file, through its mesh cache (see
+//    openMeshCache), and decodes the texture image into CPU memory, on any
+//    thread, typically as a job,
+// 2. upload then sends them to the GPU on the thread owning the GL
+//    context, a few meshes per call, spread over frames.
+class ModelImport
+{
+public:
+    ModelImport(std::string _obj_file_path, std::string _tex_file_path);
+    ~ModelImport();
+
+    bool parse(JobProgress &_progress);
+
+    // Uploads meshes for about _budget_seconds, at least one, the texture
+    // first. True once everything is on the GPU.
+    bool upload(double _budget_seconds);
+
+    // The uploaded model, with raylib's default material, and its texture.
+    // Both belong to the caller from then on.
+    Model takeModel();
+    Texture2D takeTexture();
+
+    const std::string &getObjFilePath();
+
+private:
+    std::string obj_file_path;
+    std::string tex_file_path;
+    std::vector<Mesh> meshes;
+    int uploaded_count;
+    Image image;
+    Texture2D texture;
+    bool texture_uploaded;
+
+    // Disallow copy
+    ModelImport(const ModelImport &) = delete;
+    ModelImport &operator=(const ModelImport &) = delete;
+};
@@ -2,12 +2,39 @@
 #pragma once
 
 #include "raylib.h"
+#include "tile_bins.h"
+#include "face_cache.h"
+#include "vertex_magnitudes.h"
+#include "spectrogram.h"
+#include "synth_engine.h"
+#include "active_rows.h"
+#include "wav_writer.h"
+#include "image_export.h"
+#include "job_queue.h"
+#include "mesh_cache.h"
+#include <functional>
+#include <memory>
 #include <vector>
 #include <string>
 
-typedef std::tuple<float, float, float> Point;
-
-#define BUFFER_WIDTH 1000
+// Default spectrogram resolution and element type: columns are time steps,
+// rows frequency bands. Every Muse can pick its own, see Muse::Muse.
+#define DEFAULT_BUFFER_WIDTH 1000
+#define DEFAULT_BUFFER_HEIGHT 1000
+#define DEFAULT_BUFFER_FORMAT SPECTROGRAM_UINT8
+#define TILE_SIZE 64
+
+// Default length and format of exported audio, see Muse::setDuration and
+// friends. The spectrogram's columns are spread over the whole duration.
+#define DEFAULT_AUDIO_DURATION 1.0
+#define DEFAULT_SAMPLE_RATE 44100
+#define DEFAULT_CHANNELS_COUNT 1
+#define DEFAULT_WAV_FORMAT WAV_PCM16
+
+// Exported audio is synthesized and written this many samples at a time,
+// so memory use does not grow with the duration. A multiple of
+// SYNTH_BLOCK_SAMPLES.
+#define AUDIO_CHUNK_SAMPLES (1 << 18)
 
 // Use classes when:
 
@@ -27,26 +54,80 @@ class Muse
 {
 public:
     // Constructors
-    Muse(int _count, std::string _obj_file_path, std::string _tex_file_path);
+    // Loads the model and texture through raylib, so only with a window
+    // open; defined with the rest of the GUI code in muse_gui.cpp.
+    Muse(int _count,
+         std::string _obj_file_path,
+         std::string _tex_file_path,
+         int _buffer_width = DEFAULT_BUFFER_WIDTH,
+         int _buffer_height = DEFAULT_BUFFER_HEIGHT,
+         SpectrogramFormat _buffer_format = DEFAULT_BUFFER_FORMAT);
+    // Takes over a model and texture already loaded (see ModelImport), or
+    // a model read for rasterizing only (see loadObjModel) and no texture.
+    Muse(int _count,
+         Model _model,
+         Texture2D _texture,
+         int _buffer_width = DEFAULT_BUFFER_WIDTH,
+         int _buffer_height = DEFAULT_BUFFER_HEIGHT,
+         SpectrogramFormat _buffer_format = DEFAULT_BUFFER_FORMAT);
+    // Rasterizes the model of a mesh cache (see openMeshCache), using its
+    // precomputed vertex magnitudes, without a GL context. The cache stays
+    // mapped as long as any copy of the muse uses it.
+    Muse(int _count,
+         std::shared_ptr<MeshCache> _mesh_cache,
+         int _buffer_width = DEFAULT_BUFFER_WIDTH,
+         int _buffer_height = DEFAULT_BUFFER_HEIGHT,
+         SpectrogramFormat _buffer_format = DEFAULT_BUFFER_FORMAT);
+    // A muse without a model, its spectrogram read from a file written by
+    // exportImage (see readImage), ready for synthesis straight away.
+    Muse(int _count, std::string _spectrogram_file_path);
     ~Muse();
 
     // Getters/Setters
     std::string getName();
     Model getModel();
     Texture2D getTexture();
+    int getVertexCount();
+    int getTriangleCount();
 
     // Methods
+    // These report to and can be cancelled through _progress (see
+    // JobProgress); the overloads without one run to the end.
     void rasterizeBuffer();
-    void exportImage(std::string _filename);
-    void exportAudio(std::string _filename);
+    void rasterizeBuffer(JobProgress &_progress);
+    // The exports are false if nothing, or only part, was written.
+    bool exportImage(std::string _filename);
+    bool exportImage(std::string _filename, JobProgress &_progress);
+    bool importSpectrogram(std::string _file_path);
+    bool exportAudio(std::string _filename);
+    bool exportAudio(std::string _filename, JobProgress &_progress);
+    // Needs the audio device; in muse_gui.cpp, not in muser-core.
+    void play();
     bool bufferReady();
     bool wavReady();
     bool rasterize();
-    void executePartialRender(int _current_thread, int _thread_faces_limit, int _face_index);
-    std::vector<unsigned int> getAudioBuffer();
+    const Spectrogram &getAudioBuffer();
+    int getBufferWidth();
+    int getBufferHeight();
+    SpectrogramFormat getBufferFormat();
+    SynthesisMode getSynthesisMode();
+    void setSynthesisMode(SynthesisMode _mode);
+    double getDuration();
+    void setDuration(double _seconds);
+    int getSampleRate();
+    void setSampleRate(int _sample_rate);
+    int getChannelsCount();
+    void setChannelsCount(int _channels_count);
+    ImageFileFormat getImageFormat();
+    void setImageFormat(ImageFileFormat _format);
+    WavSampleFormat getWavFormat();
+    void setWavFormat(WavSampleFormat _format);
 
 
 private:
+    // Renders samples [begin, begin + count) of the audio into the output.
+    typedef std::function<void(int64_t, int64_t, float *)> AudioRenderer;
+
     // Constructor
     Muse();
 
@@ -54,7 +135,13 @@ private:
     std::string name;
     Model model;
     Texture2D model_texture;
-    std::vector<unsigned int> audio_buffer;
+    Spectrogram audio_buffer;
+    int buffer_width;
+    int buffer_height;
+    VertexMagnitudes vertex_magnitudes;
+    std::shared_ptr<MeshCache> mesh_cache;
+    FaceCache face_cache;
+    ActiveRows active_rows;
 
     const int MAX_HERTZ = 20000;
     const int MIN_HERTZ = 1000;
@@ -65,6 +152,12 @@ private:
     float min_max_distance_difference;
     bool buffer_rasterized;
     bool wav_ready;
+    SynthesisMode synthesis_mode;
+    double duration;
+    int sample_rate;
+    int channels_count;
+    WavSampleFormat wav_format;
+    ImageFileFormat image_format;
     
     // Getters/Setters
     void setName(std::string _name);
@@ -72,33 +165,22 @@ private:
 
     // Methods
     void initMinMaxValues();
-    float calculateRealMagnitude(float _temp_raw_mag);
-    void setAudioBuffer(std::vector<unsigned int> _audio_buffer);
     void announce(std::string _text);
-    void populateFaceRasterData(std::vector<unsigned int> &face, int face_index);
-    unsigned int getFaceX1(int face_index);
-    unsigned int getFaceY1(int face_index);
-    unsigned int getFaceZ1(int face_index);
-    unsigned int getFaceX2(int face_index);
-    unsigned int getFaceY2(int face_index);
-    unsigned int getFaceZ2(int face_index);
-    unsigned int getFaceX3(int face_index);
-    unsigned int getFaceY3(int face_index);
-    unsigned int getFaceZ3(int face_index);
-    unsigned int getCoordinateValue(int point_index, int dimension_index, int face_index);
-    unsigned int getColorValue(int point_index, int face_index);
-    float getVertexDistance(std::tuple<float, float, float> vertex);
-    void orderFace(std::vector<unsigned int> &face_data);
-    void rasterizeFace(std::vector<unsigned int> &face);
-    void rasterizeTop(Point &L, Point &M, Point &H);
-    void rasterizeBottom(Point &L, Point &M, Point &H);
-    float slope(Point &_u, Point &_v);
-    float yIntercept(float _m, Point &_u);
-    float xIntercept(int &_y, float &_b, float &_m);
-    float interpolate(float _curr_x, float _curr_y, Point &_a_bound, Point &_b_bound);
-    float distance2d(float _x1, float _x2, float _y1, float _y2);
-    void rasterizeLine(int omega, Point &A, Point &B);
+    void rasterizeTile(TileBins &_bins, int _tile);
+    void buildActiveRows();
+    AudioRenderer makeRenderer();
     double Frequency(const int &row);
-    double Amplitude(const int &row, const int &sample_index, int numSamplesPerChannel);
+    template <typename T, typename Layout>
+    double Amplitude(const T *_buffer, const Layout &_layout, const int &row, const int &column);
     double GetHertzRange();
+    std::vector<double> getRowFrequencies();
+    int64_t getSamplesCount();
+    std::vector<int> getRowBins(int _fft_size);
+    int getFftSize(int64_t _samples_count);
+    template <typename Engine>
+    void loadColumns(Engine &_engine, double _gain);
+    template <typename Engine>
+    bool streamAudio(const Engine &_engine, WavWriter &_writer, JobProgress &_progress);
+    template <typename Visitor>
+    void withSynthesisEngine(const ActiveRows &_active_rows, int64_t _samples_count, Visitor _visit);
 };
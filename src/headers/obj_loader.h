@@ -0,0 +1,39 @@
+#pragma once
+
+#include "raylib.h"
+#include "job_queue.h"
+#include <string>
+#include <vector>
+
+// Triangles per mesh read by loadObjMeshes. Meshes are uploaded one at a
+// time, so this bounds the work a single upload does.
+#define OBJ_MESH_FACES (1 << 16)
+
+// Reads the OBJ file at _path into meshes held in CPU memory only: nothing
+// touches the GPU, so any thread may call this.
+//
+// The meshes are laid out as raylib's LoadModel lays them out: unindexed
+// triangles (polygons split into fans), texture v flipped, one run of
+// meshes per material in order of first use, faces in file order. Runs
+// longer than OBJ_MESH_FACES are split over several meshes, which keeps
+// the overall face order the rasterizer sees.
+//
+// The file is mapped (see MappedFile) and cut into chunks of whole lines
+// that are parsed in parallel on the thread pool, numbers read with
+// std::from_chars; the chunks are then joined and the meshes built in
+// parallel too. Normals are only read into the meshes with _with_normals.
+//
+// Progress is counted in bytes of the file. False, with _meshes empty, if
+// the file cannot be read, holds no faces, refers to missing vertices, or
+// the import is cancelled.
+bool loadObjMeshes(const std::string &_path, std::vector<Mesh> &_meshes, JobProgress &_progress, bool _with_normals = true);
+
+// Reads the OBJ file at _path into a model for rasterizing without a GL
+// context: positions and texture coordinates only, no materials, nothing
+// uploaded. It can be rasterized, not drawn.
+bool loadObjModel(const std::string &_path, Model &_model, JobProgress &_progress);
+
+// Frees the CPU side arrays of meshes that were never uploaded, and of a
+// model from loadObjModel.
+void unloadObjMeshes(std::vector<Mesh> &_meshes);
+void unloadObjModel(Model &_model);
@@ -1,3 +1,97 @@
-
 #pragma once
 
+#include "raylib.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// Samples the playback worker synthesizes per render call. A multiple of
+// SYNTH_BLOCK_SAMPLES.
+#define PLAYBACK_BLOCK_SAMPLES 4096
+
+// Room in the ring between the worker and the audio thread, in samples.
+// A power of two.
+#define PLAYBACK_RING_SAMPLES (1 << 16)
+
+// Frames per raylib stream buffer; kept small so sound starts promptly.
+#define PLAYBACK_DEVICE_FRAMES 1024
+
+// Whole buffers of silence the stream must ask for after the last sample
+// before it is stopped: raylib double buffers, so by the second one the
+// buffer holding the end has been played out.
+#define PLAYBACK_TAIL_BUFFERS 2
+
+// Lock-free ring of samples between exactly one writing thread and one
+// reading thread. Each side only moves its own index, and publishes it
+// with release ordering after touching the samples.
+class SampleRing
+{
+public:
+    // Holds up to _capacity samples, which must be a power of two.
+    explicit SampleRing(size_t _capacity);
+
+    // Copies up to _count samples in or out, returning how many moved.
+    size_t write(const float *_samples, size_t _count);
+    size_t read(float *_samples, size_t _count);
+
+    size_t getReadable() const;
+    size_t getWritable() const;
+
+    // Empties the ring. Only while neither side is using it.
+    void clear();
+
+private:
+    std::vector<float> samples;
+    size_t mask;
+    std::atomic<size_t> read_index;
+    std::atomic<size_t> write_index;
+};
+
+// Synthesizes audio block by block and plays it through a raylib
+// AudioStream as it goes, without writing a file first.
+//
+// A worker thread calls the render function for consecutive blocks and
+// pushes them into a SampleRing; raylib's audio thread pulls them out in
+// its stream callback, copies them onto every channel, and pads any
+// shortfall with silence. raylib's callback carries no user data, so there
+// is one player.
+class AudioPlayer
+{
+public:
+    // Renders samples [begin, begin + count) of the signal into the output.
+    typedef std::function<void(int64_t, int64_t, float *)> Renderer;
+
+    static AudioPlayer &instance();
+
+    // Stops whatever is playing and starts _samples_count samples from
+    // _render. The audio device must be initialized.
+    void play(Renderer _render, int64_t _samples_count, int _sample_rate, int _channels_count);
+
+    // Stops playback and releases the stream and the worker.
+    void stop();
+
+    // True from play until the last sample has been played out.
+    bool isPlaying();
+
+    // Releases a stream that has finished; call once per frame.
+    void update();
+
+private:
+    AudioPlayer();
+    ~AudioPlayer();
+
+    SampleRing ring;
+    AudioStream stream;
+    bool stream_loaded;
+    int channels_count;
+    std::thread worker;
+    std::atomic<bool> stop_requested;
+    std::atomic<bool> rendered;
+    // Silent buffers handed out since everything was rendered and read.
+    std::atomic<int> silent_buffers;
+
+    void renderLoop(Renderer _render, int64_t _samples_count);
+    static void streamCallback(void *_buffer, unsigned int _frames);
+};
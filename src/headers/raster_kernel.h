@@ -0,0 +1,82 @@
+#pragma once
+
+#include "tile_bins.h"
+#include "buffer_layout.h"
+#include "spectrogram.h"
+#include <cstdint>
+
+// A triangle corner in buffer space: integer pixel coordinates plus the
+// magnitude to be written there, on the SampleTraits<T>::magnitude_max
+// scale of the buffer's element type T.
+struct RasterVertex
+{
+    int x;
+    int y;
+    int z;
+};
+
+// Edge positions are stepped in 16.16 fixed point. Magnitudes use the
+// fixed point format of the element type, see SampleTraits.
+#define RASTER_FIXED_SHIFT 16
+#define RASTER_FIXED_ONE (1 << RASTER_FIXED_SHIFT)
+
+// Rasterizes the triangle L, M, H (sorted by ascending y) into _buffer,
+// writing only the pixels inside _clip. _layout (see buffer_layout.h) maps
+// pixels to buffer indices; it is instantiated for every element type
+// withSampleType and every layout withBufferLayout can pick.
+//
+// The magnitude gradients dz/dx and dz/dy are computed once per triangle;
+// after that, edge positions advance by a fixed point step per row and the
+// magnitude by a fixed point step per pixel, with no per-pixel division or
+// square root.
+//
+// Fill rule: pixel (x, y) is sampled at its integer coordinates and is
+// covered when
+//
+//     y_top <= y < y_bottom  and  x_left(y) <= x < x_right(y)
+//
+// where x_left/x_right are the 16.16 fixed point edge positions stepped
+// from each edge's upper end point. Top and left edges are inclusive,
+// bottom and right edges exclusive. Two faces sharing an edge compute the
+// exact same edge positions, so every pixel along it is written by exactly
+// one of them, and degenerate (zero area) faces write nothing.
+template <typename T, typename Layout>
+void rasterizeTriangle(
+    const RasterVertex &L,
+    const RasterVertex &M,
+    const RasterVertex &H,
+    const FaceBounds &_clip,
+    T *_buffer,
+    const Layout &_layout);
+
+// Writes a linear magnitude ramp: _dst[i] is the fixed point value
+// _z + i * _dz clamped to 0-max_fixed and converted by
+// SampleTraits<T>::fromFixed. Goes through the fastest span writer the host
+// CPU supports.
+template <typename T>
+void writeSpan(T *_dst, int _count, int32_t _z, int32_t _dz);
+
+// Instruction set used by writeSpan, for every element type. Every level
+// writes exactly the same values as the scalar reference.
+enum SpanWriterLevel
+{
+    SPAN_WRITER_SCALAR = 0,
+    SPAN_WRITER_SSE41,
+    SPAN_WRITER_AVX2,
+    SPAN_WRITER_AVX512,
+};
+
+// The span writer is picked on first use: the best level the CPU
+// supports, or the one named by MUSER_SIMD (scalar, sse4.1, avx2, avx512)
+// if the CPU supports that.
+SpanWriterLevel getSpanWriterLevel();
+const char *getSpanWriterName(SpanWriterLevel _level);
+
+// Switches writeSpan to _level. Returns false, leaving the writer as it
+// was, if the CPU or the build does not support it.
+bool setSpanWriterLevel(SpanWriterLevel _level);
+
+// Plain C++ span writer, kept as the reference the vector paths are
+// checked against.
+template <typename T>
+void writeSpanScalar(T *_dst, int _count, int32_t _z, int32_t _dz);
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Per-thread accounting collected by the RasterScheduler during a run.
+struct ThreadStats
+{
+    int items = 0;
+    int chunks = 0;
+    int stolen_chunks = 0;
+    double busy_ms = 0.0;
+    double idle_ms = 0.0;
+};
+
+// Hands out small chunks of rasterization work items (screen tiles) to the
+// workers of the ThreadPool.
+//
+// Items are grouped into chunks of roughly equal rasterized area (not
+// equal item count), and each worker is given a contiguous run of chunks
+// with roughly equal total area. A worker pops chunks from the front of its
+// own run and, once that is exhausted, steals chunks from the back of the
+// other workers' runs, so every item is processed exactly once no matter
+// how uneven the work is.
+class RasterScheduler
+{
+public:
+    // _item_weights holds the estimated cost (rasterized area) of each item.
+    RasterScheduler(const std::vector<float> &_item_weights, int _threads_count);
+
+    // Runs _work(begin, end) over every chunk of items on the shared
+    // ThreadPool and blocks until all chunks are done.
+    void run(std::function<void(int, int)> _work);
+
+    int getThreadsCount();
+    int getChunksCount();
+    std::vector<ThreadStats> getThreadStats();
+
+private:
+    // A chunk is a half-open range of item indices and its summed weight.
+    struct Chunk
+    {
+        int begin;
+        int end;
+        double weight;
+    };
+
+    // Each worker's run of chunk indices is packed into a single 64 bit word
+    // (front in the high half, back in the low half) so the owner popping
+    // from the front and thieves stealing from the back can both claim a
+    // chunk with one compare-and-swap.
+    struct alignas(64) WorkerQueue
+    {
+        std::atomic<uint64_t> range;
+    };
+
+    std::vector<Chunk> chunks;
+    std::unique_ptr<WorkerQueue[]> queues;
+    std::vector<ThreadStats> thread_stats;
+    int threads_count;
+
+    // Methods
+    void buildChunks(const std::vector<float> &_item_weights);
+    void assignChunks();
+    bool popFront(int _worker, int &_chunk_index);
+    bool stealBack(int _victim, int &_chunk_index);
+    void workerLoop(int _worker, std::function<void(int, int)> &_work);
+};
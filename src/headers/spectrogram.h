@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Element type of a spectrogram buffer.
+//
+// UINT8 is the classic 0-255 path. UINT16 (0-65535) and FLOAT (0.0-1.0)
+// keep much finer magnitude steps for high dynamic range renders, at two
+// and four times the memory.
+enum SpectrogramFormat
+{
+    SPECTROGRAM_UINT8 = 0,
+    SPECTROGRAM_UINT16,
+    SPECTROGRAM_FLOAT,
+};
+
+// Per element type constants shared by the rasterizer, synthesis and the
+// exporters.
+//
+// The rasterizer steps magnitudes in fixed point with fixed_shift fraction
+// bits, on an integer scale of 0 to magnitude_max. fromFixed turns a fixed
+// point value, already clamped to 0-max_fixed, into the stored element, and
+// max_value is what a full magnitude is stored as.
+//
+// The 16 bit scales leave about 1 bit of int32 headroom above max_fixed: a
+// plane climbing more than two full ranges per pixel, common on triangles a
+// few pixels across, has a gradient past the int32 range. rasterizeTriangle
+// keeps gradients in 64 bits and only hands a span to the 32 bit span
+// writers when its whole ramp fits.
+template <typename T>
+struct SampleTraits;
+
+template <>
+struct SampleTraits<uint8_t>
+{
+    static constexpr SpectrogramFormat format = SPECTROGRAM_UINT8;
+    static constexpr int magnitude_max = 255;
+    static constexpr int fixed_shift = 16;
+    static constexpr int32_t max_fixed = (256 << 16) - 1;
+    static constexpr double max_value = 255.0;
+
+    static uint8_t fromFixed(int32_t _fixed)
+    {
+        return _fixed >> fixed_shift;
+    }
+};
+
+template <>
+struct SampleTraits<uint16_t>
+{
+    static constexpr SpectrogramFormat format = SPECTROGRAM_UINT16;
+    static constexpr int magnitude_max = 65535;
+    static constexpr int fixed_shift = 14;
+    static constexpr int32_t max_fixed = (65536 << 14) - 1;
+    static constexpr double max_value = 65535.0;
+
+    static uint16_t fromFixed(int32_t _fixed)
+    {
+        return _fixed >> fixed_shift;
+    }
+};
+
+template <>
+struct SampleTraits<float>
+{
+    static constexpr SpectrogramFormat format = SPECTROGRAM_FLOAT;
+    static constexpr int magnitude_max = 65535;
+    static constexpr int fixed_shift = 14;
+    static constexpr int32_t max_fixed = 65535 << 14;
+    static constexpr double max_value = 1.0;
+
+    // Scales a fixed point magnitude onto 0.0-1.0.
+    static constexpr float fixed_scale = 1.0f / (float)(65535 << 14);
+
+    static float fromFixed(int32_t _fixed)
+    {
+        return (float)_fixed * fixed_scale;
+    }
+};
+
+// A width x height grid of magnitudes, rows being frequency bands and
+// columns time steps, stored row-major in the element type chosen by its
+// format.
+class Spectrogram
+{
+public:
+    Spectrogram();
+    Spectrogram(int _width, int _height, SpectrogramFormat _format);
+
+    int getWidth() const;
+    int getHeight() const;
+    SpectrogramFormat getFormat() const;
+    size_t getElementSize() const;
+    size_t getByteSize() const;
+
+    // Typed access to the elements. T must match the format.
+    template <typename T>
+    T *data()
+    {
+        return reinterpret_cast<T *>(this->storage.data());
+    }
+
+    template <typename T>
+    const T *data() const
+    {
+        return reinterpret_cast<const T *>(this->storage.data());
+    }
+
+    const uint8_t *bytes() const;
+
+    // Magnitude at (_x, _y) as 0.0-1.0, whatever the format.
+    double getNormalized(int _x, int _y) const;
+
+    void clear();
+
+private:
+    int width;
+    int height;
+    SpectrogramFormat format;
+    std::vector<uint8_t> storage;
+};
+
+// Calls _function with a value of the element type matching _format.
+template <typename Function>
+void withSampleType(SpectrogramFormat _format, Function _function)
+{
+    switch (_format)
+    {
+    case SPECTROGRAM_UINT16:
+        _function(uint16_t());
+        break;
+    case SPECTROGRAM_FLOAT:
+        _function(float());
+        break;
+    default:
+        _function(uint8_t());
+        break;
+    }
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include "fft.h"
+#include "active_rows.h"
+#include <cstdint>
+#include <vector>
+
+// How Muse::exportAudio turns the spectrogram into samples.
+enum SynthesisMode
+{
+    // One sine oscillator per row, see SynthEngine.
+    SYNTHESIS_OSCILLATOR_BANK = 0,
+    // One inverse FFT frame per column, see OverlapAddEngine.
+    SYNTHESIS_INVERSE_FFT,
+};
+
+// Oscillators are processed in groups of this many rows, one per vector lane.
+#define SYNTH_LANES 8
+
+// Every oscillator is put back on its exact phase at each multiple of this
+// many samples, so rounding in the phasor recurrence never builds up.
+#define SYNTH_BLOCK_SAMPLES 1024
+
+// Additive synthesis of a spectrogram with one sine oscillator per row.
+//
+// Sample n falls into column n * columns / samples, and is the sum over all
+// rows of the column's amplitude times sin(frequency * n). Instead of one
+// sin per row and sample, each row is a phasor (cos, sin) rotated by its
+// frequency once per sample, with rows spread over SIMD lanes.
+//
+// Only the rows an ActiveRows index lists for a column are visited. For
+// every run of samples sharing a column, the phasors of its active rows are
+// packed into lanes, rotated, and unpacked again. A row keeps turning from
+// run to run while it stays active, and is put back on its exact phase when
+// it lights up again.
+class SynthEngine
+{
+public:
+    // One oscillator per row, at _frequencies[row] radians per sample, over
+    // the active cells of _active_rows. The index must outlive the engine.
+    SynthEngine(const std::vector<double> &_frequencies, const ActiveRows &_active_rows, int64_t _samples_count);
+
+    int getRowsCount() const;
+    int getColumnsCount() const;
+    int64_t getSamplesCount() const;
+
+    // Amplitudes of the active rows of _column, in index order and including
+    // any gain. All zero until filled in; must not change while rendering.
+    float *getAmplitudes(int _column);
+
+    // Column sample _sample falls into, and the first sample of _column.
+    int columnOf(int64_t _sample) const;
+    int64_t firstSampleOf(int _column) const;
+
+    // Renders all samples into _out, as render(0, samples, _out).
+    void render(float *_out) const;
+
+    // Renders samples [_begin, _begin + _count) into _out, one
+    // SYNTH_BLOCK_SAMPLES block per task on the thread pool. Bit-identical
+    // to a serial renderBlock over the same range.
+    void render(int64_t _begin, int64_t _count, float *_out) const;
+
+    // Renders samples [_begin, _begin + _count) into _out on the calling
+    // thread. Phases are computed exactly at _begin and at every multiple of
+    // SYNTH_BLOCK_SAMPLES, never carried across one, so the output does not
+    // depend on how a render is split into calls as long as they start on
+    // those multiples. Safe to call from several threads at once.
+    void renderBlock(int64_t _begin, int _count, float *_out) const;
+
+private:
+    const ActiveRows *active_rows;
+    int rows_count;
+    int columns_count;
+    int64_t samples_count;
+
+    std::vector<double> frequencies;
+    std::vector<float> step_cos;
+    std::vector<float> step_sin;
+    std::vector<float> amplitudes;
+};
+
+// Adds _count samples of every oscillator group to _lanes (SYNTH_LANES sums
+// per sample), advancing the phasors in _cos/_sin. Uses AVX2 when the span
+// writers do (see getSpanWriterLevel), the scalar loop otherwise; both do
+// the same operations in the same order.
+void renderOscillators(
+    const float *_amplitudes,
+    const float *_step_cos,
+    const float *_step_sin,
+    float *_cos,
+    float *_sin,
+    int _rows,
+    int _count,
+    float *_lanes);
+
+// Spectral synthesis of a spectrogram: every column is one short-time
+// Fourier frame.
+//
+// Each row is assigned an FFT bin. A column's frame holds the row
+// amplitudes at their bins, with phases taken from the frame's position in
+// the signal so a bin that stays lit across columns continues as one
+// unbroken sine. The frame is inverse transformed, Hann windowed and added
+// into the output, which is finally divided by the sum of the windows over
+// it. A steady row thus plays at the same level as with SynthEngine.
+//
+// Costs O(columns * N log N) for an N point transform instead of
+// O(samples * rows).
+class OverlapAddEngine
+{
+public:
+    // Row r plays at bin _bins[r] of a _fft_size point transform (a power of
+    // two), that is at _bins[r] * sample rate / _fft_size Hz. Only the
+    // active cells of _active_rows are synthesized; the index must outlive
+    // the engine.
+    OverlapAddEngine(const std::vector<int> &_bins, int _fft_size, const ActiveRows &_active_rows, int64_t _samples_count);
+
+    int getRowsCount() const;
+    int getColumnsCount() const;
+    int64_t getSamplesCount() const;
+    int getFftSize() const;
+
+    // Amplitudes of the active rows of _column, as
+    // SynthEngine::getAmplitudes.
+    float *getAmplitudes(int _column);
+
+    // First sample of _column, as SynthEngine::firstSampleOf.
+    int64_t firstSampleOf(int _column) const;
+
+    // Renders all samples into _out, as render(0, samples, _out).
+    void render(float *_out) const;
+
+    // Renders samples [_begin, _begin + _count) into _out, from every frame
+    // that overlaps them. Frames are transformed, and added up over blocks
+    // of samples, in parallel on the thread pool. Every sample sums its
+    // frames and windows in column order, so the result is bit-identical
+    // whatever the number of threads or the way a render is split into
+    // ranges. Frames straddling two ranges are transformed for both.
+    void render(int64_t _begin, int64_t _count, float *_out) const;
+
+private:
+    const ActiveRows *active_rows;
+    int rows_count;
+    int columns_count;
+    int64_t samples_count;
+    int fft_size;
+
+    RealFft fft;
+    std::vector<int> bins;
+    std::vector<float> window;
+    std::vector<float> amplitudes;
+
+    // e^(2 pi i q / fft_size) for every q.
+    std::vector<float> phase_cos;
+    std::vector<float> phase_sin;
+
+    int64_t frameStart(int _column) const;
+    int firstFrameEndingAfter(int64_t _sample) const;
+    void synthesizeFrame(int _column, float *_real, float *_imag, float *_frame) const;
+};
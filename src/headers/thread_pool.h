@@ -0,0 +1,80 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class TaskGroup;
+
+// Process-wide pool of worker threads shared by every Muse.
+//
+// The workers are created once, on first use, and live until the process
+// exits. Work is submitted through a TaskGroup; the pool serves the groups
+// that have pending tasks round-robin, so several muses rasterizing or
+// exporting at the same time get an even share of the workers instead of
+// whoever queued first getting all of them.
+class ThreadPool
+{
+public:
+    ~ThreadPool();
+
+    // The shared pool, started with the configured settings on first call.
+    static ThreadPool &instance();
+
+    // Sets the number of workers (0 means one per hardware thread) and
+    // whether each worker is pinned to its own CPU. If the pool is already
+    // running, it is restarted with the new settings, so this must only be
+    // called while no tasks are in flight.
+    static void configure(int _threads_count, bool _pin_threads);
+
+    int getThreadsCount();
+
+private:
+    friend class TaskGroup;
+
+    ThreadPool(int _threads_count, bool _pin_threads);
+
+    std::vector<std::thread> workers;
+    std::deque<TaskGroup *> ready_groups;
+    std::mutex queue_mutex;
+    std::condition_variable queue_condition;
+    bool stopping;
+
+    // Methods
+    void start(int _threads_count, bool _pin_threads);
+    void stop();
+    void workerLoop();
+    void pinThread(std::thread &_thread, int _worker);
+    void schedule(TaskGroup *_group);
+    bool runNextTask(TaskGroup *_group);
+};
+
+// A batch of tasks submitted to the ThreadPool that can be waited on as a
+// whole. Waiting does not just block: the waiting thread runs the group's
+// queued tasks itself, which also makes it safe to wait on a group from
+// inside another pool task.
+class TaskGroup
+{
+public:
+    TaskGroup(ThreadPool &_pool = ThreadPool::instance());
+    ~TaskGroup();
+
+    void run(std::function<void()> _task);
+    void wait();
+
+private:
+    friend class ThreadPool;
+
+    ThreadPool &pool;
+    std::deque<std::function<void()>> tasks;
+    std::condition_variable done_condition;
+    int pending;
+    bool scheduled;
+
+    // Disallow copy
+    TaskGroup(const TaskGroup &) = delete;
+    TaskGroup &operator=(const TaskGroup &) = delete;
+};
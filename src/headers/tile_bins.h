@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+
+// Pixel bounding box of a face, half-open on both axes. A face that should
+// not be rasterized has an empty box (x0 >= x1 or y0 >= y1).
+struct FaceBounds
+{
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+};
+
+// Sorts faces into square screen tiles of the spectrogram.
+//
+// Each tile keeps the indices of the faces overlapping it in submission
+// (face index) order, so rasterizing a tile's faces in list order gives
+// exactly the pixels a single-threaded pass over all faces would, while a
+// tile is only ever written by the one worker rasterizing it.
+class TileBins
+{
+public:
+    TileBins(int _width, int _height, int _tile_size);
+
+    // Bins every face with a non-empty box, in parallel on the ThreadPool.
+    void build(const std::vector<FaceBounds> &_bounds);
+
+    int getTilesCount();
+    FaceBounds getTileBounds(int _tile);
+    const int *tileFacesBegin(int _tile);
+    const int *tileFacesEnd(int _tile);
+
+    // Estimated cost of each tile: the clipped area of its faces, plus one
+    // per face for setup.
+    std::vector<float> getTileWeights();
+
+private:
+    int width;
+    int height;
+    int tile_size;
+    int tiles_x;
+    int tiles_y;
+
+    // CSR layout: the faces of tile t are tile_faces[tile_offsets[t]] up to
+    // tile_faces[tile_offsets[t + 1]].
+    std::vector<int> tile_offsets;
+    std::vector<int> tile_faces;
+    std::vector<float> tile_weights;
+
+    // Methods
+    bool tileRange(const FaceBounds &_bounds, FaceBounds &_tiles);
+};
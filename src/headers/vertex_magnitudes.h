@@ -0,0 +1,36 @@
+#pragma once
+
+#include "raylib.h"
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Distance from the origin of every vertex of a model, along with the
+// smallest and largest of them across all its meshes.
+//
+// Computed in one parallel, vectorized pass; each pool task reduces the
+// min/max of its own block as it goes, so normalization and the face cache
+// both reuse the same pass instead of recomputing distances per face.
+//
+// The distances of all meshes are stored back to back, mesh by mesh: vertex
+// v of mesh m is at distances[mesh_offsets[m] + v]. They never change once
+// built, so copies share them; they may also live in a mapped MeshCache,
+// which they then keep open (see MeshCache::getMagnitudes).
+class VertexMagnitudes
+{
+public:
+    std::shared_ptr<const float> distances;
+    size_t distances_count = 0;
+    std::vector<int> mesh_offsets;
+    float min_distance = 0.0f;
+    float max_distance = 0.0f;
+
+    void build(const Model &_model);
+    bool empty();
+};
+
+// Writes the distance from the origin of _count packed xyz vertices into
+// _distances and folds them into _min/_max. Uses AVX2 when the span writers
+// do (see getSpanWriterLevel), the scalar loop otherwise; both give the same
+// results.
+void computeVertexDistances(const float *_vertices, int _count, float *_distances, float &_min, float &_max);
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Sample encoding of a WavWriter file.
+enum WavSampleFormat
+{
+    WAV_PCM16 = 0,
+    WAV_PCM24,
+    WAV_FLOAT32,
+};
+
+// Encoded samples are gathered into a buffer of this many bytes before
+// each write to the file.
+#define WAV_WRITE_BUFFER_BYTES (1 << 20)
+
+// Writes a WAV file block by block, so a render of any length never has to
+// sit in memory whole.
+//
+// The header is built once on open, with placeholder sizes and a reserved
+// JUNK chunk, and written again with the real sizes on close. Past 4 GB the
+// 32 bit sizes overflow, so close turns the file into RF64 instead: the
+// JUNK chunk becomes the ds64 chunk holding the 64 bit sizes. Float files
+// also carry a fact chunk with the length in frames, patched the same way.
+class WavWriter
+{
+public:
+    WavWriter();
+    ~WavWriter();
+
+    // Starts _path with the given format. False if it cannot be created.
+    bool open(std::string _path, int _sample_rate, int _channels_count, WavSampleFormat _format = WAV_PCM16);
+
+    // Appends _count frames of a mono signal, copied onto every channel.
+    // PCM samples are clamped to [-1, 1] and scaled by 32767 or 8388607,
+    // truncating; float samples are written as they are.
+    bool writeMono(const float *_samples, int64_t _count);
+
+    // Flushes, patches the header sizes and closes the file. Also done by
+    // the destructor; false if anything failed since open.
+    bool close();
+
+    int64_t getFramesCount() const;
+
+private:
+    std::ofstream file;
+    int sample_rate;
+    int channels_count;
+    WavSampleFormat format;
+    int64_t frames_count;
+
+    std::vector<uint8_t> header;
+    // Where the fact chunk starts in the header; 0 for PCM, which has none.
+    size_t fact_offset;
+    std::vector<uint8_t> buffer;
+    size_t buffer_used;
+    std::vector<uint8_t> encoded;
+    bool failed;
+
+    int getBytesPerSample() const;
+    void buildHeader();
+    void flush();
+};
+
+// Encodes _count samples as little endian 16 bit PCM, 24 bit PCM or 32 bit
+// float into _out. Uses AVX2 when the span writers do (see
+// getSpanWriterLevel), the scalar loop otherwise; both give the same bytes.
+// The 24 bit AVX2 path may write up to 4 bytes past the last sample.
+void encodeWavSamples(const float *_samples, int64_t _count, WavSampleFormat _format, uint8_t *_out);
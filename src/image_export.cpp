@@ -0,0 +1,517 @@
+#include "image_export.h"
+#include "thread_pool.h"
+#include "deflate.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+// Rows converted per pool task.
+static const int ROWS_PER_BAND = 64;
+
+// Raw bytes per PNG band. Each band is compressed on its own, so smaller
+// bands spread better over the pool but lose the history before them.
+static const size_t PNG_BAND_BYTES = 128 * 1024;
+
+static const uint8_t PNG_SIGNATURE[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+
+// Pixel values at maxval 255 and 65535. Floats are scaled in single
+// precision and rounded half up, as std::lround would.
+static unsigned int pixel8(uint8_t _value)
+{
+    return _value;
+}
+static unsigned int pixel8(uint16_t _value)
+{
+    return ((unsigned int)_value * 255 + 32767) / 65535;
+}
+static unsigned int pixel8(float _value)
+{
+    return (unsigned int)((double)(std::min(std::max(_value, 0.0f), 1.0f) * 255.0f) + 0.5);
+}
+
+static unsigned int pixel16(uint8_t _value)
+{
+    return (unsigned int)_value * 257;
+}
+static unsigned int pixel16(uint16_t _value)
+{
+    return _value;
+}
+static unsigned int pixel16(float _value)
+{
+    return (unsigned int)((double)(std::min(std::max(_value, 0.0f), 1.0f) * 65535.0f) + 0.5);
+}
+
+ImageFileFormat getBinaryImageFormat(SpectrogramFormat _format)
+{
+    return (_format == SPECTROGRAM_UINT8) ? IMAGE_PGM_8 : IMAGE_PGM_16;
+}
+
+const char *getImageExtension(ImageFileFormat _format)
+{
+    switch (_format)
+    {
+    case IMAGE_PGM_ASCII:
+        return ".ppm";
+    case IMAGE_PNG_8:
+    case IMAGE_PNG_16:
+    case IMAGE_PNG_COLORMAP:
+        return ".png";
+    case IMAGE_SPECTROGRAM:
+        return ".spec";
+    default:
+        return ".pgm";
+    }
+}
+
+static bool isPng(ImageFileFormat _format)
+{
+    return _format == IMAGE_PNG_8 || _format == IMAGE_PNG_16 || _format == IMAGE_PNG_COLORMAP;
+}
+
+// RGB of every 8 bit magnitude: black through purple, red and orange to
+// pale yellow, interpolated linearly between those stops.
+static const uint8_t *heatColormap()
+{
+    static const struct Colormap
+    {
+        uint8_t rgb[256 * 3];
+
+        Colormap()
+        {
+            const int stops_count = 5;
+            const float stops[stops_count][3] = {
+                {0, 0, 4}, {87, 16, 110}, {188, 55, 84}, {249, 142, 9}, {252, 255, 164}};
+
+            for (int value = 0; value < 256; value++)
+            {
+                float position = value * (stops_count - 1) / 255.0f;
+                int stop = std::min((int)position, stops_count - 2);
+                float t = position - stop;
+                for (int channel = 0; channel < 3; channel++)
+                {
+                    float mixed = stops[stop][channel] + ((stops[stop + 1][channel] - stops[stop][channel]) * t);
+                    this->rgb[(value * 3) + channel] = (uint8_t)(mixed + 0.5f);
+                }
+            }
+        }
+    } colormap;
+
+    return colormap.rgb;
+}
+
+static void putLittleEndian32(uint8_t *_at, uint32_t _value)
+{
+    _at[0] = _value & 0xFF;
+    _at[1] = (_value >> 8) & 0xFF;
+    _at[2] = (_value >> 16) & 0xFF;
+    _at[3] = _value >> 24;
+}
+
+static void putBigEndian32(uint8_t *_at, uint32_t _value)
+{
+    _at[0] = _value >> 24;
+    _at[1] = (_value >> 16) & 0xFF;
+    _at[2] = (_value >> 8) & 0xFF;
+    _at[3] = _value & 0xFF;
+}
+
+// Appends a PNG chunk: length, type, data, and the CRC of type and data.
+static void appendPngChunk(std::vector<uint8_t> &_out, const char *_type, const uint8_t *_data, size_t _size)
+{
+    const size_t start = _out.size();
+    _out.resize(start + 12 + _size);
+    uint8_t *at = _out.data() + start;
+
+    putBigEndian32(at, _size);
+    std::memcpy(at + 4, _type, 4);
+    if (_size > 0)
+        std::memcpy(at + 8, _data, _size);
+    putBigEndian32(at + 8 + _size, crc32(at + 4, 4 + _size));
+}
+
+static std::string imageHeader(const Spectrogram &_spectrogram, ImageFileFormat _format)
+{
+    bool wide = (_format == IMAGE_PGM_16) ||
+                (_format == IMAGE_PGM_ASCII && _spectrogram.getFormat() != SPECTROGRAM_UINT8);
+
+    return std::string((_format == IMAGE_PGM_ASCII) ? "P2\n" : "P5\n") +
+           std::to_string(_spectrogram.getWidth()) + " " + std::to_string(_spectrogram.getHeight()) + "\n" +
+           (wide ? "65535\n" : "255\n");
+}
+
+// Writes rows [_row_begin, _row_end) of a binary image to _out.
+template <typename T>
+static void encodeBinaryRows(const Spectrogram &_spectrogram, ImageFileFormat _format, int _row_begin, int _row_end, uint8_t *_out)
+{
+    const int width = _spectrogram.getWidth();
+    const T *rows = _spectrogram.data<T>() + ((size_t)_row_begin * width);
+    const size_t count = (size_t)(_row_end - _row_begin) * width;
+
+    if (_format == IMAGE_PGM_8)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            _out[i] = pixel8(rows[i]);
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        unsigned int value = pixel16(rows[i]);
+        _out[(2 * i)] = value >> 8;
+        _out[(2 * i) + 1] = value & 0xFF;
+    }
+}
+
+// Formats rows [_row_begin, _row_end) of a P2 image, every value followed
+// by a space and every row by a newline.
+template <typename T>
+static std::string encodeTextRows(const Spectrogram &_spectrogram, int _row_begin, int _row_end)
+{
+    const int width = _spectrogram.getWidth();
+    const bool wide = (_spectrogram.getFormat() != SPECTROGRAM_UINT8);
+    const T *buffer = _spectrogram.data<T>();
+
+    // At most five digits and a space per value, and a newline per row.
+    std::string text(((size_t)(_row_end - _row_begin) * ((width * 6) + 1)), '\0');
+    char *at = &text[0];
+
+    for (int y = _row_begin; y < _row_end; y++)
+    {
+        const T *row = buffer + ((size_t)y * width);
+        for (int x = 0; x < width; x++)
+        {
+            at = std::to_chars(at, at + 5, wide ? pixel16(row[x]) : pixel8(row[x])).ptr;
+            *at++ = ' ';
+        }
+        *at++ = '\n';
+    }
+
+    text.resize(at - text.data());
+    return text;
+}
+
+// Unfiltered PNG bytes of row _y.
+template <typename T>
+static void pngRow(const Spectrogram &_spectrogram, ImageFileFormat _format, int _y, uint8_t *_out)
+{
+    const int width = _spectrogram.getWidth();
+    const T *row = _spectrogram.data<T>() + ((size_t)_y * width);
+
+    switch (_format)
+    {
+    case IMAGE_PNG_16:
+        for (int x = 0; x < width; x++)
+        {
+            unsigned int value = pixel16(row[x]);
+            _out[(2 * x)] = value >> 8;
+            _out[(2 * x) + 1] = value & 0xFF;
+        }
+        break;
+    case IMAGE_PNG_COLORMAP:
+    {
+        const uint8_t *colormap = heatColormap();
+        for (int x = 0; x < width; x++)
+        {
+            std::memcpy(_out + (3 * x), colormap + (3 * pixel8(row[x])), 3);
+        }
+        break;
+    }
+    default:
+        for (int x = 0; x < width; x++)
+        {
+            _out[x] = pixel8(row[x]);
+        }
+        break;
+    }
+}
+
+static uint8_t paeth(int _left, int _above, int _above_left)
+{
+    int estimate = _left + _above - _above_left;
+    int to_left = std::abs(estimate - _left);
+    int to_above = std::abs(estimate - _above);
+    int to_above_left = std::abs(estimate - _above_left);
+
+    if (to_left <= to_above && to_left <= to_above_left)
+        return _left;
+    if (to_above <= to_above_left)
+        return _above;
+    return _above_left;
+}
+
+// Writes the filter type byte and the filtered bytes of _row to _out,
+// trying all five PNG filters and keeping the one with the smallest sum of
+// absolute (signed) values, the usual heuristic for what deflates best.
+// _above is the previous row, zeros for the first. _scratch holds five
+// rows.
+static void filterPngRow(const uint8_t *_row, const uint8_t *_above, size_t _bytes, int _pixel_bytes, uint8_t *_scratch, uint8_t *_out)
+{
+    uint8_t *filtered[5];
+    for (int filter = 0; filter < 5; filter++)
+    {
+        filtered[filter] = _scratch + (filter * _bytes);
+    }
+
+    for (size_t i = 0; i < _bytes; i++)
+    {
+        const int left = (i >= (size_t)_pixel_bytes) ? _row[i - _pixel_bytes] : 0;
+        const int above_left = (i >= (size_t)_pixel_bytes) ? _above[i - _pixel_bytes] : 0;
+        const int above = _above[i];
+
+        filtered[0][i] = _row[i];
+        filtered[1][i] = _row[i] - left;
+        filtered[2][i] = _row[i] - above;
+        filtered[3][i] = _row[i] - ((left + above) >> 1);
+        filtered[4][i] = _row[i] - paeth(left, above, above_left);
+    }
+
+    int best = 0;
+    uint64_t best_cost = UINT64_MAX;
+    for (int filter = 0; filter < 5; filter++)
+    {
+        uint64_t cost = 0;
+        for (size_t i = 0; i < _bytes; i++)
+        {
+            cost += std::abs((int8_t)filtered[filter][i]);
+        }
+        if (cost < best_cost)
+        {
+            best = filter;
+            best_cost = cost;
+        }
+    }
+
+    _out[0] = best;
+    std::memcpy(_out + 1, filtered[best], _bytes);
+}
+
+static std::vector<uint8_t> encodePng(const Spectrogram &_spectrogram, ImageFileFormat _format, JobProgress &_progress)
+{
+    const int width = _spectrogram.getWidth();
+    const int height = _spectrogram.getHeight();
+    const int pixel_bytes = (_format == IMAGE_PNG_16) ? 2 : (_format == IMAGE_PNG_COLORMAP) ? 3 : 1;
+    const size_t row_bytes = (size_t)width * pixel_bytes;
+
+    const int rows_per_band = std::max<int>(1, PNG_BAND_BYTES / (row_bytes + 1));
+    const int bands_count = (height + rows_per_band - 1) / rows_per_band;
+
+    // Every band becomes one IDAT chunk holding its piece of the zlib
+    // stream, the first one behind the zlib header.
+    std::vector<std::vector<uint8_t>> chunks(bands_count);
+    std::vector<uint32_t> adlers(bands_count);
+    std::vector<size_t> filtered_sizes(bands_count);
+
+    TaskGroup encoders;
+    for (int band = 0; band < bands_count; band++)
+    {
+        encoders.run([&, band]()
+        {
+            if (_progress.isCancelled())
+                return;
+
+            const int row_begin = band * rows_per_band;
+            const int row_end = std::min(height, row_begin + rows_per_band);
+
+            // Rows row_begin - 1 to row_end - 1, the first as context.
+            std::vector<uint8_t> rows((size_t)(row_end - row_begin + 1) * row_bytes, 0);
+            std::vector<uint8_t> filtered((size_t)(row_end - row_begin) * (row_bytes + 1));
+            std::vector<uint8_t> scratch(5 * row_bytes);
+
+            withSampleType(_spectrogram.getFormat(), [&](auto _sample)
+            {
+                using T = decltype(_sample);
+                for (int y = std::max(row_begin - 1, 0); y < row_end; y++)
+                {
+                    pngRow<T>(_spectrogram, _format, y, rows.data() + ((size_t)(y - row_begin + 1) * row_bytes));
+                }
+            });
+
+            for (int y = row_begin; y < row_end; y++)
+            {
+                const uint8_t *row = rows.data() + ((size_t)(y - row_begin + 1) * row_bytes);
+                filterPngRow(row, row - row_bytes, row_bytes, pixel_bytes, scratch.data(),
+                             filtered.data() + ((size_t)(y - row_begin) * (row_bytes + 1)));
+            }
+
+            adlers[band] = adler32(filtered.data(), filtered.size());
+            filtered_sizes[band] = filtered.size();
+
+            std::vector<uint8_t> compressed;
+            if (band == 0)
+            {
+                compressed.push_back(0x78);
+                compressed.push_back(0x01);
+            }
+            deflateBlock(filtered.data(), filtered.size(), band == bands_count - 1, compressed);
+
+            appendPngChunk(chunks[band], "IDAT", compressed.data(), compressed.size());
+            _progress.advance(row_end - row_begin);
+        });
+    }
+    encoders.wait();
+
+    if (_progress.isCancelled())
+        return std::vector<uint8_t>();
+
+    uint32_t adler = 1;
+    for (int band = 0; band < bands_count; band++)
+    {
+        adler = adler32Combine(adler, adlers[band], filtered_sizes[band]);
+    }
+
+    uint8_t header[13] = {0};
+    putBigEndian32(header, width);
+    putBigEndian32(header + 4, height);
+    header[8] = (_format == IMAGE_PNG_16) ? 16 : 8;
+    header[9] = (_format == IMAGE_PNG_COLORMAP) ? 2 : 0;
+
+    size_t size = sizeof(PNG_SIGNATURE) + (12 + sizeof(header)) + (12 + 4) + 12;
+    for (const std::vector<uint8_t> &chunk : chunks)
+    {
+        size += chunk.size();
+    }
+
+    std::vector<uint8_t> image(PNG_SIGNATURE, PNG_SIGNATURE + sizeof(PNG_SIGNATURE));
+    image.reserve(size);
+    appendPngChunk(image, "IHDR", header, sizeof(header));
+    for (const std::vector<uint8_t> &chunk : chunks)
+    {
+        image.insert(image.end(), chunk.begin(), chunk.end());
+    }
+
+    // The zlib trailer closes the stream in an IDAT of its own.
+    uint8_t trailer[4];
+    putBigEndian32(trailer, adler);
+    appendPngChunk(image, "IDAT", trailer, sizeof(trailer));
+    appendPngChunk(image, "IEND", nullptr, 0);
+    return image;
+}
+
+// The elements are copied as they are; every target we build for is
+// little endian.
+static std::vector<uint8_t> encodeSpectrogram(const Spectrogram &_spectrogram)
+{
+    std::vector<uint8_t> file(SPECTROGRAM_FILE_HEADER_SIZE + _spectrogram.getByteSize());
+    std::memcpy(file.data(), SPECTROGRAM_FILE_MAGIC, 8);
+    putLittleEndian32(file.data() + 8, SPECTROGRAM_FILE_VERSION);
+    putLittleEndian32(file.data() + 12, _spectrogram.getWidth());
+    putLittleEndian32(file.data() + 16, _spectrogram.getHeight());
+    putLittleEndian32(file.data() + 20, _spectrogram.getFormat());
+    std::memcpy(file.data() + SPECTROGRAM_FILE_HEADER_SIZE, _spectrogram.bytes(), _spectrogram.getByteSize());
+    return file;
+}
+
+std::vector<uint8_t> encodeImage(const Spectrogram &_spectrogram, ImageFileFormat _format)
+{
+    JobProgress progress;
+    return encodeImage(_spectrogram, _format, progress);
+}
+
+std::vector<uint8_t> encodeImage(const Spectrogram &_spectrogram, ImageFileFormat _format, JobProgress &_progress)
+{
+    const int height = _spectrogram.getHeight();
+    _progress.start(height);
+
+    if (isPng(_format))
+        return encodePng(_spectrogram, _format, _progress);
+    if (_format == IMAGE_SPECTROGRAM)
+    {
+        std::vector<uint8_t> file = encodeSpectrogram(_spectrogram);
+        _progress.advance(height);
+        return file;
+    }
+
+    const int bands_count = (height + ROWS_PER_BAND - 1) / ROWS_PER_BAND;
+    const std::string header = imageHeader(_spectrogram, _format);
+
+    if (_format == IMAGE_PGM_ASCII)
+    {
+        std::vector<std::string> bands(bands_count);
+
+        TaskGroup encoders;
+        for (int band = 0; band < bands_count; band++)
+        {
+            encoders.run([&_spectrogram, band, height, &bands, &_progress]()
+            {
+                if (_progress.isCancelled())
+                    return;
+
+                const int row_end = std::min(height, (band + 1) * ROWS_PER_BAND);
+                withSampleType(_spectrogram.getFormat(), [&](auto _sample)
+                {
+                    bands[band] = encodeTextRows<decltype(_sample)>(_spectrogram, band * ROWS_PER_BAND, row_end);
+                });
+                _progress.advance(row_end - (band * ROWS_PER_BAND));
+            });
+        }
+        encoders.wait();
+
+        if (_progress.isCancelled())
+            return std::vector<uint8_t>();
+
+        size_t size = header.size();
+        for (const std::string &band : bands)
+        {
+            size += band.size();
+        }
+
+        std::vector<uint8_t> image(size);
+        uint8_t *at = std::copy(header.begin(), header.end(), image.data());
+        for (const std::string &band : bands)
+        {
+            at = std::copy(band.begin(), band.end(), at);
+        }
+        return image;
+    }
+
+    const size_t row_bytes = (size_t)_spectrogram.getWidth() * ((_format == IMAGE_PGM_16) ? 2 : 1);
+    std::vector<uint8_t> image(header.size() + (row_bytes * height));
+    std::copy(header.begin(), header.end(), image.data());
+    uint8_t *pixels = image.data() + header.size();
+
+    TaskGroup encoders;
+    for (int band = 0; band < bands_count; band++)
+    {
+        encoders.run([&_spectrogram, _format, band, height, row_bytes, pixels, &_progress]()
+        {
+            if (_progress.isCancelled())
+                return;
+
+            const int row_begin = band * ROWS_PER_BAND;
+            const int row_end = std::min(height, row_begin + ROWS_PER_BAND);
+            withSampleType(_spectrogram.getFormat(), [&](auto _sample)
+            {
+                encodeBinaryRows<decltype(_sample)>(_spectrogram, _format, row_begin, row_end, pixels + (row_bytes * row_begin));
+            });
+            _progress.advance(row_end - row_begin);
+        });
+    }
+    encoders.wait();
+
+    if (_progress.isCancelled())
+        return std::vector<uint8_t>();
+    return image;
+}
+
+bool writeImage(const std::string &_path, const Spectrogram &_spectrogram, ImageFileFormat _format)
+{
+    JobProgress progress;
+    return writeImage(_path, _spectrogram, _format, progress);
+}
+
+bool writeImage(const std::string &_path, const Spectrogram &_spectrogram, ImageFileFormat _format, JobProgress &_progress)
+{
+    std::vector<uint8_t> image = encodeImage(_spectrogram, _format, _progress);
+    if (_progress.isCancelled())
+        return false;
+
+    std::ofstream file(_path, std::ios::binary | std::ios::trunc);
+    file.write((const char *)image.data(), image.size());
+    file.close();
+    return (bool)file;
+}
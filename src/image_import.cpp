@@ -0,0 +1,183 @@
+#include "image_import.h"
+#include "image_export.h"
+#include "mapped_file.h"
+#include <algorithm>
+#include <charconv>
+#include <climits>
+#include <cstring>
+
+static uint32_t getLittleEndian32(const uint8_t *_at)
+{
+    return (uint32_t)_at[0] | ((uint32_t)_at[1] << 8) | ((uint32_t)_at[2] << 16) | ((uint32_t)_at[3] << 24);
+}
+
+static bool isBlank(uint8_t _byte)
+{
+    return _byte == ' ' || _byte == '\t' || _byte == '\n' || _byte == '\r' || _byte == '\v' || _byte == '\f';
+}
+
+// Moves _at past whitespace and '#' comments.
+static void skipBlanks(const uint8_t *&_at, const uint8_t *_end)
+{
+    while (_at < _end)
+    {
+        if (*_at == '#')
+        {
+            while (_at < _end && *_at != '\n')
+                _at++;
+        }
+        else if (isBlank(*_at))
+        {
+            _at++;
+        }
+        else
+        {
+            return;
+        }
+    }
+}
+
+// Reads the next unsigned decimal number. False at the end of the data or
+// on anything else.
+static bool readNumber(const uint8_t *&_at, const uint8_t *_end, unsigned int &_value)
+{
+    skipBlanks(_at, _end);
+    auto result = std::from_chars((const char *)_at, (const char *)_end, _value);
+    if (result.ec != std::errc())
+        return false;
+    _at = (const uint8_t *)result.ptr;
+    return true;
+}
+
+// Scales a value at _maxval onto _max, rounding to nearest.
+static unsigned int rescale(unsigned int _value, unsigned int _maxval, unsigned int _max)
+{
+    if (_maxval == _max)
+        return _value;
+    return (unsigned int)(((uint64_t)std::min(_value, _maxval) * _max + (_maxval / 2)) / _maxval);
+}
+
+static bool decodeSpectrogram(const uint8_t *_data, size_t _size, Spectrogram &_out)
+{
+    if (_size < SPECTROGRAM_FILE_HEADER_SIZE || getLittleEndian32(_data + 8) != SPECTROGRAM_FILE_VERSION)
+        return false;
+
+    const uint32_t width = getLittleEndian32(_data + 12);
+    const uint32_t height = getLittleEndian32(_data + 16);
+    const uint32_t format = getLittleEndian32(_data + 20);
+    // An empty spectrogram has no columns to synthesize.
+    if (width == 0 || height == 0 || width > INT_MAX || height > INT_MAX || format > SPECTROGRAM_FLOAT)
+        return false;
+
+    // Checked before allocating, so a bad header cannot ask for more
+    // memory than the file holds.
+    const size_t element_size = (format == SPECTROGRAM_UINT8) ? 1 : (format == SPECTROGRAM_UINT16) ? 2 : 4;
+    if ((uint64_t)width * element_size > (_size - SPECTROGRAM_FILE_HEADER_SIZE) / height)
+        return false;
+    if ((uint64_t)width * height * element_size != _size - SPECTROGRAM_FILE_HEADER_SIZE)
+        return false;
+
+    Spectrogram spectrogram(width, height, (SpectrogramFormat)format);
+    std::memcpy(spectrogram.data<uint8_t>(), _data + SPECTROGRAM_FILE_HEADER_SIZE, spectrogram.getByteSize());
+    _out = std::move(spectrogram);
+    return true;
+}
+
+template <typename T>
+static bool decodeNetpbmPixels(const uint8_t *_at, const uint8_t *_end, bool _binary, unsigned int _maxval, Spectrogram &_spectrogram)
+{
+    const unsigned int max = (unsigned int)SampleTraits<T>::max_value;
+    const size_t count = (size_t)_spectrogram.getWidth() * _spectrogram.getHeight();
+    T *pixels = _spectrogram.data<T>();
+
+    if (!_binary)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            unsigned int value;
+            if (!readNumber(_at, _end, value) || value > _maxval)
+                return false;
+            pixels[i] = rescale(value, _maxval, max);
+        }
+        return true;
+    }
+
+    // A single whitespace byte separates the header from the samples.
+    _at++;
+    const size_t sample_bytes = (_maxval > 255) ? 2 : 1;
+    if (_at > _end || (size_t)(_end - _at) / sample_bytes < count)
+        return false;
+
+    if (sample_bytes == 1)
+    {
+        if (_maxval == max)
+        {
+            std::memcpy(pixels, _at, count);
+            return true;
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            pixels[i] = rescale(_at[i], _maxval, max);
+        }
+        return true;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        unsigned int value = ((unsigned int)_at[(2 * i)] << 8) | _at[(2 * i) + 1];
+        pixels[i] = rescale(value, _maxval, max);
+    }
+    return true;
+}
+
+static bool decodeNetpbm(const uint8_t *_data, size_t _size, Spectrogram &_out)
+{
+    const uint8_t *at = _data + 2;
+    const uint8_t *end = _data + _size;
+    const bool binary = (_data[1] == '5');
+
+    unsigned int width, height, maxval;
+    if (!readNumber(at, end, width) || !readNumber(at, end, height) || !readNumber(at, end, maxval))
+        return false;
+    if (width == 0 || height == 0 || width > INT_MAX || height > INT_MAX || maxval == 0 || maxval > 65535)
+        return false;
+
+    // Every pixel takes at least a byte, text or binary, so this bounds the
+    // allocation by the file size.
+    if (width > _size / height)
+        return false;
+
+    bool decoded = false;
+    Spectrogram spectrogram(width, height, (maxval > 255) ? SPECTROGRAM_UINT16 : SPECTROGRAM_UINT8);
+    withSampleType(spectrogram.getFormat(), [&](auto _sample)
+    {
+        typedef decltype(_sample) T;
+        decoded = decodeNetpbmPixels<T>(at, end, binary, maxval, spectrogram);
+    });
+
+    if (!decoded)
+        return false;
+
+    _out = std::move(spectrogram);
+    return true;
+}
+
+bool decodeImage(const uint8_t *_data, size_t _size, Spectrogram &_out)
+{
+    if (_size >= 8 && std::memcmp(_data, SPECTROGRAM_FILE_MAGIC, 8) == 0)
+        return decodeSpectrogram(_data, _size, _out);
+
+    if (_size >= 2 && _data[0] == 'P' && (_data[1] == '2' || _data[1] == '5'))
+        return decodeNetpbm(_data, _size, _out);
+
+    return false;
+}
+
+bool readImage(const std::string &_path, Spectrogram &_out)
+{
+    MappedFile file;
+    if (!file.open(_path))
+        return false;
+
+    return decodeImage(file.data(), file.size(), _out);
+}
@@ -0,0 +1,190 @@
+#include "job_queue.h"
+#include <algorithm>
+
+JobProgress::JobProgress()
+{
+    this->done = 0;
+    this->total = 0;
+    this->cancelled = false;
+}
+
+void JobProgress::start(int64_t _total)
+{
+    this->done = 0;
+    this->total = _total;
+}
+
+void JobProgress::advance(int64_t _done)
+{
+    this->done += _done;
+}
+
+int64_t JobProgress::getDone() const
+{
+    return this->done;
+}
+
+int64_t JobProgress::getTotal() const
+{
+    return this->total;
+}
+
+double JobProgress::getFraction() const
+{
+    const int64_t total = this->total;
+    if (total <= 0)
+        return 0.0;
+    return std::min(1.0, (double)this->done / total);
+}
+
+void JobProgress::cancel()
+{
+    this->cancelled = true;
+}
+
+bool JobProgress::isCancelled() const
+{
+    return this->cancelled;
+}
+
+JobQueue::JobQueue()
+{
+    this->stopping = false;
+    this->worker = std::thread(&JobQueue::workerLoop, this);
+}
+
+JobQueue::~JobQueue()
+{
+    cancelAll();
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->condition.notify_all();
+    this->worker.join();
+}
+
+void JobQueue::submit(size_t _owner, std::string _label, Work _work, Done _done)
+{
+    std::shared_ptr<Job> job = std::make_shared<Job>();
+    job->owner = _owner;
+    job->label = _label;
+    job->work = _work;
+    job->done = _done;
+    job->succeeded = false;
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->queued.push_back(job);
+    }
+    this->condition.notify_all();
+}
+
+void JobQueue::cancelWhere(std::function<bool(const Job &)> _matches)
+{
+    std::unique_lock<std::mutex> lock(this->mutex);
+
+    auto matches = [&_matches](const std::shared_ptr<Job> &_job)
+    {
+        return _matches(*_job);
+    };
+    this->queued.erase(std::remove_if(this->queued.begin(), this->queued.end(), matches), this->queued.end());
+    this->finished.erase(std::remove_if(this->finished.begin(), this->finished.end(), matches), this->finished.end());
+
+    std::shared_ptr<Job> job = this->running;
+    if (!job || !_matches(*job))
+        return;
+
+    job->progress.cancel();
+    this->condition.wait(lock, [this, &job]()
+    {
+        return this->running != job;
+    });
+}
+
+void JobQueue::cancel(size_t _owner)
+{
+    cancelWhere([_owner](const Job &_job)
+    {
+        return _job.owner == _owner;
+    });
+}
+
+void JobQueue::cancelAll()
+{
+    cancelWhere([](const Job &)
+    {
+        return true;
+    });
+}
+
+bool JobQueue::isBusy(size_t _owner)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    if (this->running && this->running->owner == _owner)
+        return true;
+    for (const std::shared_ptr<Job> &job : this->queued)
+    {
+        if (job->owner == _owner)
+            return true;
+    }
+    return false;
+}
+
+bool JobQueue::getStatus(std::string &_label, double &_fraction)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    if (!this->running)
+        return false;
+    _label = this->running->label;
+    _fraction = this->running->progress.getFraction();
+    return true;
+}
+
+void JobQueue::update()
+{
+    std::vector<std::shared_ptr<Job>> jobs;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        jobs.swap(this->finished);
+    }
+
+    // Outside the lock, as callbacks may submit more jobs.
+    for (const std::shared_ptr<Job> &job : jobs)
+    {
+        if (job->done)
+            job->done(job->succeeded);
+    }
+}
+
+void JobQueue::workerLoop()
+{
+    std::unique_lock<std::mutex> lock(this->mutex);
+    while (true)
+    {
+        this->condition.wait(lock, [this]()
+        {
+            return this->stopping || !this->queued.empty();
+        });
+        if (this->stopping)
+            return;
+
+        std::shared_ptr<Job> job = this->queued.front();
+        this->queued.pop_front();
+        this->running = job;
+
+        lock.unlock();
+        bool succeeded = job->work(job->progress);
+        lock.lock();
+
+        // A cancelled job's owner may already be gone, so it is not told.
+        job->succeeded = succeeded && !job->progress.isCancelled();
+        if (!job->progress.isCancelled())
+            this->finished.push_back(job);
+        this->running = nullptr;
+        this->condition.notify_all();
+    }
+}
@@ -31,11 +31,16 @@
 #include "raygui.h"
 
 #include "muse.h"
+#include "thread_pool.h"
+#include "play_audio.h"
+#include "job_queue.h"
+#include "model_import.h"
 #include <iostream>
+#include <deque>
+#include <memory>
 #include <map>
 #include <string>
 #include <functional>
-#include <ctime>
 
 typedef enum
 {
@@ -60,6 +65,27 @@ typedef enum
 std::map<size_t, Muse> muse_map;
 std::map<size_t, Muse>::iterator current_muse;
 
+// Key of the next muse loaded, in muse_map and as its jobs' owner. Never
+// reused, so imports running side by side never collide.
+size_t next_muse_key = 1;
+
+// Rasterizing and exporting run here, owned by their muse's key in
+// muse_map, so the window keeps drawing meanwhile.
+JobQueue job_queue;
+
+char status_barText[128] = "";
+
+// Sets the status bar text, cut short if it does not fit.
+static void SetStatusText(const std::string &_text)
+{
+    snprintf(status_barText, sizeof(status_barText), "%s", _text.c_str());
+}
+
+// Imports parsed by their job and waiting for the GPU, by muse key. The
+// front one is uploaded a little every frame, see UpdateImports.
+std::deque<std::pair<size_t, std::shared_ptr<ModelImport>>> pending_imports;
+const double import_upload_seconds = 0.004;
+
 //----------------------------------------------------------------------------------
 // Controls Functions Declaration
 //----------------------------------------------------------------------------------
@@ -77,23 +103,133 @@ static void ButtonCastle();
 static UiRasterState getUiRasterState();
 static UiEmptyState getUiEmptyState();
 static UiArrowState getUiArrowState();
+static bool currentMuseBusy();
+static void cancelCurrentMuseJobs();
 
 // standalone functions should be pascal case
 
-void LoadMuse(std::string _obj, std::string _tex)
+// True for files written by Muse::exportImage that can be read back
+// instead of rasterizing a model.
+bool IsSpectrogramPath(const std::string &_path)
 {
+    for (const char *extension : {".pgm", ".ppm", ".spec"})
+    {
+        size_t length = strlen(extension);
+        if (_path.size() >= length && _path.compare(_path.size() - length, length, extension) == 0)
+            return true;
+    }
+    return false;
+}
 
-    time_t now = time(0);
-    char *dt = ctime(&now);
-    std::hash<std::string> hasher;
-    size_t hash = hasher(std::string(dt));
+// Applies the MUSER_* environment settings to a new muse.
+void ConfigureMuse(Muse &muse)
+{
+    // MUSER_SYNTHESIS=ifft renders audio by inverse FFT instead of the
+    // oscillator bank.
+    const char *synthesis_env = getenv("MUSER_SYNTHESIS");
+    if (synthesis_env && std::string(synthesis_env) == "ifft")
+        muse.setSynthesisMode(SYNTHESIS_INVERSE_FFT);
+
+    // MUSER_DURATION (seconds), MUSER_SAMPLE_RATE and MUSER_CHANNELS
+    // override the exported audio's defaults.
+    if (const char *duration_env = getenv("MUSER_DURATION"))
+        muse.setDuration(atof(duration_env));
+    if (const char *rate_env = getenv("MUSER_SAMPLE_RATE"))
+        muse.setSampleRate(atoi(rate_env));
+    if (const char *channels_env = getenv("MUSER_CHANNELS"))
+        muse.setChannelsCount(atoi(channels_env));
+
+    // MUSER_IMAGE_FORMAT=p2, p5, p5_16, png, png16, png_colormap or spec
+    // picks the exported image format.
+    const char *image_format_env = getenv("MUSER_IMAGE_FORMAT");
+    if (image_format_env && std::string(image_format_env) == "p2")
+        muse.setImageFormat(IMAGE_PGM_ASCII);
+    else if (image_format_env && std::string(image_format_env) == "p5")
+        muse.setImageFormat(IMAGE_PGM_8);
+    else if (image_format_env && std::string(image_format_env) == "p5_16")
+        muse.setImageFormat(IMAGE_PGM_16);
+    else if (image_format_env && std::string(image_format_env) == "png")
+        muse.setImageFormat(IMAGE_PNG_8);
+    else if (image_format_env && std::string(image_format_env) == "png16")
+        muse.setImageFormat(IMAGE_PNG_16);
+    else if (image_format_env && std::string(image_format_env) == "png_colormap")
+        muse.setImageFormat(IMAGE_PNG_COLORMAP);
+    else if (image_format_env && std::string(image_format_env) == "spec")
+        muse.setImageFormat(IMAGE_SPECTROGRAM);
+
+    // MUSER_WAV_FORMAT=pcm24 or float32 picks the exported sample encoding.
+    const char *wav_format_env = getenv("MUSER_WAV_FORMAT");
+    if (wav_format_env && std::string(wav_format_env) == "pcm24")
+        muse.setWavFormat(WAV_PCM24);
+    else if (wav_format_env && std::string(wav_format_env) == "float32")
+        muse.setWavFormat(WAV_FLOAT32);
+}
 
-    std::cout << std::to_string(hash) << std::endl;
+// Stores _muse under _key and makes it the current muse.
+void AddMuse(size_t _key, Muse _muse)
+{
+    ConfigureMuse(_muse);
 
+    cancelCurrentMuseJobs();
     muse_map.insert(
         std::pair<size_t, Muse>(
-            hash,
-            Muse(muse_map.size(), _obj, _tex)));
+            _key,
+            _muse));
+    current_muse = muse_map.find(_key);
+
+    SetStatusText("Loaded model \"" + current_muse->second.getName() + "\". " + std::to_string(current_muse->second.getVertexCount()) + " Vertices, " + std::to_string(current_muse->second.getTriangleCount()) + " Texels. Check console for any errors.");
+}
+
+// Spectrograms are read right away. Models are parsed by a job, then
+// uploaded over the next frames by UpdateImports, which adds the muse.
+void LoadMuse(std::string _obj, std::string _tex)
+{
+    size_t key = next_muse_key++;
+
+    if (IsSpectrogramPath(_obj))
+    {
+        Muse muse(muse_map.size(), _obj);
+        if (!muse.bufferReady())
+        {
+            SetStatusText("Could not read a spectrogram from \"" + _obj + "\".");
+            return;
+        }
+        AddMuse(key, muse);
+        return;
+    }
+
+    std::shared_ptr<ModelImport> import = std::make_shared<ModelImport>(_obj, _tex);
+    job_queue.submit(
+        key,
+        "Importing model \"" + _obj + "\"...",
+        [import](JobProgress &_progress)
+        {
+            return import->parse(_progress);
+        },
+        [import, key](bool _parsed)
+        {
+            if (_parsed)
+                pending_imports.push_back(std::make_pair(key, import));
+            else
+                SetStatusText("Could not import model \"" + import->getObjFilePath() + "\".");
+        });
+}
+
+// Uploads the oldest parsed import for a few milliseconds, so frames keep
+// coming while large models reach the GPU.
+void UpdateImports()
+{
+    if (pending_imports.empty())
+        return;
+
+    std::shared_ptr<ModelImport> import = pending_imports.front().second;
+    SetStatusText("Uploading model \"" + import->getObjFilePath() + "\"...");
+    if (!import->upload(import_upload_seconds))
+        return;
+
+    size_t key = pending_imports.front().first;
+    pending_imports.pop_front();
+    AddMuse(key, Muse(muse_map.size(), import->takeModel(), import->takeTexture()));
 }
 
 void UnloadMuse(Muse _muse)
@@ -116,7 +252,6 @@ void ClearMuses()
 const int screenWidth = 800;
 const int screenHeight = 513;
 
-char status_barText[128] = "";
 
 const char *button_importText = "IMPORT";
 const char *import_windowText = "IMPORT";
@@ -144,6 +279,14 @@ char import_texture_inputText[128] = "";
 
 int main(void)
 {
+    // MUSER_THREADS sets the size of the shared worker pool (default: one per
+    // hardware thread), MUSER_PIN_THREADS=1 pins each worker to its own CPU.
+    const char *threads_env = getenv("MUSER_THREADS");
+    const char *pin_env = getenv("MUSER_PIN_THREADS");
+    ThreadPool::configure(
+        threads_env ? atoi(threads_env) : 0,
+        pin_env ? atoi(pin_env) != 0 : false);
+
     InitWindow(screenWidth, screenHeight, "Muser");
     InitAudioDevice();
 
@@ -166,6 +309,16 @@ int main(void)
     while (!WindowShouldClose()) // Detect window close button or ESC key
     {
         UpdateCamera(&camera);
+        AudioPlayer::instance().update();
+        job_queue.update();
+        UpdateImports();
+
+        // While a job runs its progress replaces the status text.
+        std::string job_label;
+        double job_fraction = 0.0;
+        std::string status_text = status_barText;
+        if (job_queue.getStatus(job_label, job_fraction))
+            status_text = job_label + " " + std::to_string((int)(job_fraction * 100.0)) + "%";
 
         // Draw
         //----------------------------------------------------------------------------------
@@ -202,7 +355,7 @@ int main(void)
                 ImportButtonSubmit();
         }
 
-        GuiStatusBar((Rectangle){0, 497, 800, 20}, status_barText);
+        GuiStatusBar((Rectangle){0, 497, 800, 20}, status_text.c_str());
         if (GuiButton((Rectangle){8, 464, 56, 24}, button_importText))
             ButtonImport();
 
@@ -253,8 +406,11 @@ int main(void)
         case UiEmptyState::STATE_NOT_EMPTY:
             if (GuiButton((Rectangle){anchor02.x + -40, anchor02.y + 0, 64, 24}, button_deleteText))
                 ButtonDelete();
+            if (currentMuseBusy())
+                GuiDisable();
             if (GuiButton((Rectangle){anchor02.x + 32, anchor02.y + 0, 80, 24}, button_convertText))
                 ButtonConvert();
+            GuiEnable();
             break;
         }
 
@@ -276,7 +432,9 @@ int main(void)
             break;
         }
 
-        if (!current_muse->second.wavReady())
+        // Playback synthesizes on the fly, so it only needs a rasterized
+        // buffer, not an exported file.
+        if (getUiRasterState() == UiRasterState::STATE_NOT_RASTERIZED)
         {
             GuiDisable();
             if (GuiButton((Rectangle){anchor02.x + 312, anchor02.y + 0, 48, 24}, button_playText))
@@ -304,8 +462,11 @@ int main(void)
         //----------------------------------------------------------------------------------
     }
 
+    job_queue.cancelAll();
+    pending_imports.clear();
     ClearMuses();
 
+    AudioPlayer::instance().stop();
     CloseAudioDevice();
     CloseWindow(); // Close window and OpenGL context
 
@@ -344,9 +505,23 @@ static UiEmptyState getUiEmptyState()
     }
 }
 
+// A muse with jobs pending is left alone by the UI thread until they are
+// done: its buffer may be half written.
+static bool currentMuseBusy()
+{
+    return !muse_map.empty() && job_queue.isBusy(current_muse->first);
+}
+
+// Switching away from or deleting a muse cancels whatever it is doing.
+static void cancelCurrentMuseJobs()
+{
+    if (!muse_map.empty())
+        job_queue.cancel(current_muse->first);
+}
+
 static UiRasterState getUiRasterState()
 {
-    if (current_muse->second.bufferReady())
+    if (!muse_map.empty() && !currentMuseBusy() && current_muse->second.bufferReady())
     {
         return UiRasterState::STATE_RASTERIZED;
     }
@@ -372,10 +547,6 @@ static void ImportButtonSubmit()
         import_model_inputText,
         import_texture_inputText);
 
-    // assuming the above went well ->
-
-    current_muse = muse_map.begin();
-    strcpy(status_barText, ("Loaded model \"" + current_muse->second.getName() + "\". " + std::to_string(current_muse->second.getModel().meshes[0].vertexCount) + " Vertices, " + std::to_string(current_muse->second.getModel().meshes[0].triangleCount) + " Texels. Check console for any errors.").c_str());
     import_windowActive = false;
 }
 
@@ -383,6 +554,7 @@ static void ButtonLeft()
 {
     if (muse_map.size() > 1)
     {
+        cancelCurrentMuseJobs();
         current_muse = std::prev(current_muse, 1);
         strcpy(status_barText, ("Model \"" + current_muse->second.getName() + "\" loaded.").c_str());
     }
@@ -396,6 +568,8 @@ static void ButtonDelete()
     }
     else
     {
+        cancelCurrentMuseJobs();
+
         std::string model_name = current_muse->second.getName();
         if (muse_map.size() == 1)
         {
@@ -414,21 +588,47 @@ static void ButtonDelete()
     }
 }
 
-// currently this is happening in the ui thread, but this needs to happen elsewhere.
 static void ButtonExportPpm()
 {
-    std::string model_name = current_muse->second.getName();
-    strcpy(status_barText, ("Exporting " + model_name + " to image...").c_str());
-    current_muse->second.exportImage(model_name);
-    strcpy(status_barText, ("Exported model \"" + model_name + "\" to " + model_name + ".ppm.").c_str());
+    Muse *muse = &current_muse->second;
+    std::string model_name = muse->getName();
+    std::string file_name = model_name + getImageExtension(muse->getImageFormat());
+
+    job_queue.submit(
+        current_muse->first,
+        "Exporting " + model_name + " to image...",
+        [muse, model_name](JobProgress &_progress)
+        {
+            return muse->exportImage(model_name, _progress);
+        },
+        [model_name, file_name](bool _exported)
+        {
+            if (_exported)
+                SetStatusText("Exported model \"" + model_name + "\" to " + file_name + ".");
+            else
+                SetStatusText("Could not export model \"" + model_name + "\" to " + file_name + ".");
+        });
 }
 
 static void ButtonExportWav()
 {
-    std::string model_name = current_muse->second.getName();
-    strcpy(status_barText, ("Exporting " + model_name + " to audio...").c_str());
-    current_muse->second.exportAudio(model_name);
-    strcpy(status_barText, ("Exported model \"" + model_name + "\" to " + model_name + ".wav.").c_str());
+    Muse *muse = &current_muse->second;
+    std::string model_name = muse->getName();
+
+    job_queue.submit(
+        current_muse->first,
+        "Exporting " + model_name + " to audio...",
+        [muse, model_name](JobProgress &_progress)
+        {
+            return muse->exportAudio(model_name, _progress);
+        },
+        [model_name](bool _exported)
+        {
+            if (_exported)
+                SetStatusText("Exported model \"" + model_name + "\" to " + model_name + ".wav.");
+            else
+                SetStatusText("Could not export model \"" + model_name + "\" to " + model_name + ".wav.");
+        });
 }
 
 static void ButonRight()
@@ -437,6 +637,7 @@ static void ButonRight()
     {
         if (current_muse != std::prev(muse_map.end(), 1))
         {
+            cancelCurrentMuseJobs();
             current_muse = std::next(current_muse, 1);
             strcpy(status_barText, ("Model \"" + current_muse->second.getName() + "\" loaded.").c_str());
         }
@@ -445,20 +646,30 @@ static void ButonRight()
 
 static void ButtonPlay()
 {
-    std::string file_path = "./" + current_muse->second.getName() + ".wav";
-    Sound muse_wav = LoadSound(file_path.c_str());
-
-    SetSoundVolume(muse_wav, 1);
-    PlaySoundMulti(muse_wav);
-
-    UnloadSound(muse_wav);
+    current_muse->second.play();
+    strcpy(status_barText, ("Playing \"" + current_muse->second.getName() + "\".").c_str());
 }
 
 static void ButtonConvert()
 {
-    strcpy(status_barText, ("Rasterizing \"" + current_muse->second.getName() + "\"...").c_str());
-    current_muse->second.rasterizeBuffer();
-    strcpy(status_barText, ("Finished rasterizing \"" + current_muse->second.getName() + "\".").c_str());
+    Muse *muse = &current_muse->second;
+    std::string model_name = muse->getName();
+
+    job_queue.submit(
+        current_muse->first,
+        "Rasterizing \"" + model_name + "\"...",
+        [muse](JobProgress &_progress)
+        {
+            muse->rasterizeBuffer(_progress);
+            return muse->bufferReady();
+        },
+        [model_name](bool _rasterized)
+        {
+            if (_rasterized)
+                SetStatusText("Finished rasterizing \"" + model_name + "\".");
+            else
+                SetStatusText("Could not rasterize \"" + model_name + "\".");
+        });
 }
 
 static void ButtonMuffin()
@@ -472,11 +683,6 @@ static void ButtonMuffin()
         default_model,
         default_texture);
 
-    // assuming the above went well ->
-
-    // current_muse = muse_map.find(std::to_string(muse_map.size() - 1));
-    current_muse = muse_map.begin();
-    strcpy(status_barText, ("Loaded model \"" + current_muse->second.getName() + "\". " + std::to_string(current_muse->second.getModel().meshes[0].vertexCount) + " Vertices, " + std::to_string(current_muse->second.getModel().meshes[0].triangleCount) + " Texels. Check console for any errors.").c_str());
     import_windowActive = false;
     std::cout << muse_map.size() << std::endl;
 }
@@ -492,11 +698,6 @@ static void ButtonCastle()
         default_model,
         default_texture);
 
-    // assuming the above went well ->
-
-    // current_muse = muse_map.find(std::to_string(muse_map.size() - 1));
-    current_muse = muse_map.begin();
-    strcpy(status_barText, ("Loaded model \"" + current_muse->second.getName() + "\". " + std::to_string(current_muse->second.getModel().meshes[0].vertexCount) + " Vertices, " + std::to_string(current_muse->second.getModel().meshes[0].triangleCount) + " Texels. Check console for any errors.").c_str());
     import_windowActive = false;
     std::cout << muse_map.size() << std::endl;
 }
\ No newline at end of file
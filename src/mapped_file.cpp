@@ -0,0 +1,97 @@
+#include "mapped_file.h"
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MAPPED_FILE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+{
+    this->bytes = nullptr;
+    this->length = 0;
+    this->mapped = false;
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const std::string &_path)
+{
+    close();
+
+#ifdef MAPPED_FILE_MMAP
+    int descriptor = ::open(_path.c_str(), O_RDONLY);
+    if (descriptor < 0)
+        return false;
+
+    struct stat status;
+    if (fstat(descriptor, &status) != 0)
+    {
+        ::close(descriptor);
+        return false;
+    }
+
+    // An empty file cannot be mapped, but is still a valid (empty) view.
+    if (status.st_size > 0)
+    {
+        void *address = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if (address != MAP_FAILED)
+        {
+            madvise(address, status.st_size, MADV_SEQUENTIAL);
+            this->bytes = (const uint8_t *)address;
+            this->length = status.st_size;
+            this->mapped = true;
+        }
+    }
+    ::close(descriptor);
+
+    if (this->mapped || status.st_size == 0)
+        return true;
+#endif
+
+    std::ifstream file(_path, std::ios::binary | std::ios::ate);
+    if (!file)
+        return false;
+
+    this->contents = std::vector<uint8_t>((size_t)file.tellg());
+    file.seekg(0);
+    file.read((char *)this->contents.data(), this->contents.size());
+    if (!file)
+    {
+        this->contents.clear();
+        return false;
+    }
+
+    this->bytes = this->contents.data();
+    this->length = this->contents.size();
+    return true;
+}
+
+void MappedFile::close()
+{
+#ifdef MAPPED_FILE_MMAP
+    if (this->mapped)
+        munmap((void *)this->bytes, this->length);
+#endif
+    this->bytes = nullptr;
+    this->length = 0;
+    this->mapped = false;
+    this->contents.clear();
+    this->contents.shrink_to_fit();
+}
+
+const uint8_t *MappedFile::data() const
+{
+    return this->bytes;
+}
+
+size_t MappedFile::size() const
+{
+    return this->length;
+}
@@ -0,0 +1,315 @@
+#include "mesh_cache.h"
+#include "obj_loader.h"
+#include "thread_pool.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MESH_CACHE_PROCESS_ID
+#include <unistd.h>
+#endif
+
+// Bytes hashed per pool task.
+static const size_t HASH_CHUNK_BYTES = 4 << 20;
+
+static const uint64_t HASH_PRIME_1 = 0x9E3779B185EBCA87ull;
+static const uint64_t HASH_PRIME_2 = 0xC2B2AE3D27D4EB4Full;
+
+static uint64_t hashRound(uint64_t _hash, uint64_t _value)
+{
+    _hash ^= _value * HASH_PRIME_2;
+    _hash = (_hash << 31) | (_hash >> 33);
+    return _hash * HASH_PRIME_1;
+}
+
+static uint64_t hashChunk(const uint8_t *_data, size_t _size)
+{
+    uint64_t hash = HASH_PRIME_1 ^ _size;
+    size_t i = 0;
+    for (; i + 8 <= _size; i += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, _data + i, 8);
+        hash = hashRound(hash, word);
+    }
+
+    uint64_t tail = 0;
+    std::memcpy(&tail, _data + i, _size - i);
+    return hashRound(hash, tail);
+}
+
+bool hashFile(const std::string &_path, uint64_t &_hash, JobProgress &_progress)
+{
+    MappedFile file;
+    if (!file.open(_path))
+        return false;
+
+    const size_t chunks_count = (file.size() + HASH_CHUNK_BYTES - 1) / HASH_CHUNK_BYTES;
+    std::vector<uint64_t> chunk_hashes(chunks_count);
+    _progress.start(file.size());
+
+    TaskGroup hashers;
+    for (size_t chunk = 0; chunk < chunks_count; chunk++)
+    {
+        hashers.run([&file, &chunk_hashes, chunk, &_progress]()
+        {
+            if (_progress.isCancelled())
+                return;
+
+            const size_t begin = chunk * HASH_CHUNK_BYTES;
+            const size_t size = std::min(HASH_CHUNK_BYTES, file.size() - begin);
+            chunk_hashes[chunk] = hashChunk(file.data() + begin, size);
+            _progress.advance(size);
+        });
+    }
+    hashers.wait();
+
+    if (_progress.isCancelled())
+        return false;
+
+    uint64_t hash = hashRound(HASH_PRIME_2, file.size());
+    for (uint64_t chunk_hash : chunk_hashes)
+    {
+        hash = hashRound(hash, chunk_hash);
+    }
+    _hash = hash;
+    return true;
+}
+
+std::string getMeshCachePath(const std::string &_obj_path, uint64_t _hash)
+{
+    const char *cache_dir = getenv("MUSER_MESH_CACHE_DIR");
+    if (!cache_dir || !*cache_dir)
+        return _obj_path + ".musemesh";
+
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.musemesh", (unsigned long long)_hash);
+    return std::string(cache_dir) + "/" + name;
+}
+
+static size_t alignUp(size_t _offset)
+{
+    return (_offset + MESH_CACHE_ALIGNMENT - 1) & ~(size_t)(MESH_CACHE_ALIGNMENT - 1);
+}
+
+// Where the table and each array start, for the given counts.
+struct MeshCacheLayout
+{
+    size_t positions;
+    size_t texcoords;
+    size_t distances;
+    size_t size;
+
+    MeshCacheLayout(uint32_t _meshes_count, uint64_t _vertices_count)
+    {
+        this->positions = alignUp(MESH_CACHE_HEADER_SIZE + ((size_t)_meshes_count * 8));
+        this->texcoords = alignUp(this->positions + (_vertices_count * 3 * sizeof(float)));
+        this->distances = alignUp(this->texcoords + (_vertices_count * 2 * sizeof(float)));
+        this->size = this->distances + (_vertices_count * sizeof(float));
+    }
+};
+
+MeshCache::MeshCache()
+{
+    this->distances = nullptr;
+    this->min_distance = 0.0f;
+    this->max_distance = 0.0f;
+}
+
+bool MeshCache::open(const std::string &_path, uint64_t _source_hash)
+{
+    this->meshes.clear();
+    if (!this->file.open(_path))
+        return false;
+
+    const uint8_t *data = this->file.data();
+    const size_t size = this->file.size();
+    if (size < MESH_CACHE_HEADER_SIZE || std::memcmp(data, MESH_CACHE_MAGIC, 8) != 0)
+        return false;
+
+    uint32_t version, meshes_count;
+    uint64_t source_hash, vertices_count;
+    std::memcpy(&version, data + 8, 4);
+    std::memcpy(&meshes_count, data + 12, 4);
+    std::memcpy(&source_hash, data + 16, 8);
+    std::memcpy(&vertices_count, data + 24, 8);
+    std::memcpy(&this->min_distance, data + 32, 4);
+    std::memcpy(&this->max_distance, data + 36, 4);
+
+    if (version != MESH_CACHE_VERSION || source_hash != _source_hash || vertices_count > INT32_MAX)
+        return false;
+    if (meshes_count > (size - MESH_CACHE_HEADER_SIZE) / 8)
+        return false;
+
+    const MeshCacheLayout layout(meshes_count, vertices_count);
+    if (layout.size != size)
+        return false;
+
+    float *positions = (float *)(data + layout.positions);
+    float *texcoords = (float *)(data + layout.texcoords);
+    this->distances = (const float *)(data + layout.distances);
+
+    std::vector<Mesh> meshes(meshes_count);
+    this->mesh_offsets = std::vector<int>(meshes_count + 1, 0);
+    for (uint32_t mesh = 0; mesh < meshes_count; mesh++)
+    {
+        uint32_t counts[2];
+        std::memcpy(counts, data + MESH_CACHE_HEADER_SIZE + (mesh * 8), 8);
+
+        // Meshes are unindexed, so their faces read triangleCount * 3
+        // vertices of the mapping.
+        const uint64_t offset = this->mesh_offsets[mesh];
+        if (counts[0] > vertices_count - offset || (uint64_t)counts[1] * 3 > counts[0])
+            return false;
+
+        meshes[mesh] = Mesh{};
+        meshes[mesh].vertexCount = counts[0];
+        meshes[mesh].triangleCount = counts[1];
+        meshes[mesh].vertices = positions + (offset * 3);
+        meshes[mesh].texcoords = texcoords + (offset * 2);
+        this->mesh_offsets[mesh + 1] = offset + counts[0];
+    }
+    if ((uint64_t)this->mesh_offsets[meshes_count] != vertices_count)
+        return false;
+
+    this->meshes = meshes;
+    return true;
+}
+
+// A name next to _path for writing it aside, unique to this process and
+// thread, so processes building the same cache at once never write into
+// each other's file. Whichever renames last wins; the contents are the same.
+static std::string getTemporaryPath(const std::string &_path)
+{
+    unsigned long long process_id = 0;
+#ifdef MESH_CACHE_PROCESS_ID
+    process_id = getpid();
+#endif
+    const size_t thread_id = std::hash<std::thread::id>()(std::this_thread::get_id());
+
+    char suffix[64];
+    snprintf(suffix, sizeof(suffix), ".%llu.%zx.tmp", process_id, thread_id);
+    return _path + suffix;
+}
+
+bool MeshCache::write(const std::string &_path, uint64_t _source_hash, const Model &_model, const VertexMagnitudes &_magnitudes, JobProgress &_progress)
+{
+    const uint32_t meshes_count = _model.meshCount;
+    const uint64_t vertices_count = _magnitudes.distances_count;
+    const MeshCacheLayout layout(meshes_count, vertices_count);
+
+    std::vector<uint8_t> header(layout.positions, 0);
+    const uint32_t version = MESH_CACHE_VERSION;
+    std::memcpy(header.data(), MESH_CACHE_MAGIC, 8);
+    std::memcpy(header.data() + 8, &version, 4);
+    std::memcpy(header.data() + 12, &meshes_count, 4);
+    std::memcpy(header.data() + 16, &_source_hash, 8);
+    std::memcpy(header.data() + 24, &vertices_count, 8);
+    std::memcpy(header.data() + 32, &_magnitudes.min_distance, 4);
+    std::memcpy(header.data() + 36, &_magnitudes.max_distance, 4);
+    for (uint32_t mesh = 0; mesh < meshes_count; mesh++)
+    {
+        const uint32_t counts[2] = {(uint32_t)_model.meshes[mesh].vertexCount, (uint32_t)_model.meshes[mesh].triangleCount};
+        std::memcpy(header.data() + MESH_CACHE_HEADER_SIZE + (mesh * 8), counts, 8);
+    }
+
+    const std::string temporary_path = getTemporaryPath(_path);
+    std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+    if (!file)
+        return false;
+
+    // Progress is counted in bytes; cancellation is checked between
+    // meshes.
+    const char padding[MESH_CACHE_ALIGNMENT] = {0};
+    _progress.start(layout.size);
+    file.write((const char *)header.data(), header.size());
+    for (int mesh = 0; mesh < _model.meshCount && !_progress.isCancelled(); mesh++)
+    {
+        file.write((const char *)_model.meshes[mesh].vertices, (size_t)_model.meshes[mesh].vertexCount * 3 * sizeof(float));
+        _progress.advance((size_t)_model.meshes[mesh].vertexCount * 3 * sizeof(float));
+    }
+    file.write(padding, layout.texcoords - (layout.positions + (vertices_count * 3 * sizeof(float))));
+    for (int mesh = 0; mesh < _model.meshCount && !_progress.isCancelled(); mesh++)
+    {
+        file.write((const char *)_model.meshes[mesh].texcoords, (size_t)_model.meshes[mesh].vertexCount * 2 * sizeof(float));
+        _progress.advance((size_t)_model.meshes[mesh].vertexCount * 2 * sizeof(float));
+    }
+    file.write(padding, layout.distances - (layout.texcoords + (vertices_count * 2 * sizeof(float))));
+    if (!_progress.isCancelled())
+        file.write((const char *)_magnitudes.distances.get(), vertices_count * sizeof(float));
+    _progress.advance(vertices_count * sizeof(float));
+
+    file.close();
+    if (!file || _progress.isCancelled())
+    {
+        std::remove(temporary_path.c_str());
+        return false;
+    }
+    return std::rename(temporary_path.c_str(), _path.c_str()) == 0;
+}
+
+Model MeshCache::getModel()
+{
+    Model model = {};
+    model.transform = Matrix{1.0f, 0.0f, 0.0f, 0.0f,
+                             0.0f, 1.0f, 0.0f, 0.0f,
+                             0.0f, 0.0f, 1.0f, 0.0f,
+                             0.0f, 0.0f, 0.0f, 1.0f};
+    model.meshCount = this->meshes.size();
+    model.meshes = this->meshes.data();
+    return model;
+}
+
+void MeshCache::copyMeshes(std::vector<Mesh> &_meshes)
+{
+    _meshes.resize(this->meshes.size());
+    for (size_t mesh = 0; mesh < this->meshes.size(); mesh++)
+    {
+        const Mesh &source = this->meshes[mesh];
+        _meshes[mesh] = Mesh{};
+        _meshes[mesh].vertexCount = source.vertexCount;
+        _meshes[mesh].triangleCount = source.triangleCount;
+        _meshes[mesh].vertices = (float *)RL_MALLOC((size_t)source.vertexCount * 3 * sizeof(float));
+        _meshes[mesh].texcoords = (float *)RL_MALLOC((size_t)source.vertexCount * 2 * sizeof(float));
+        std::memcpy(_meshes[mesh].vertices, source.vertices, (size_t)source.vertexCount * 3 * sizeof(float));
+        std::memcpy(_meshes[mesh].texcoords, source.texcoords, (size_t)source.vertexCount * 2 * sizeof(float));
+    }
+}
+
+void MeshCache::getMagnitudes(VertexMagnitudes &_magnitudes)
+{
+    _magnitudes.distances = std::shared_ptr<const float>(shared_from_this(), this->distances);
+    _magnitudes.distances_count = this->mesh_offsets.back();
+    _magnitudes.mesh_offsets = this->mesh_offsets;
+    _magnitudes.min_distance = this->min_distance;
+    _magnitudes.max_distance = this->max_distance;
+}
+
+std::shared_ptr<MeshCache> openMeshCache(const std::string &_obj_path, JobProgress &_progress)
+{
+    uint64_t hash;
+    if (!hashFile(_obj_path, hash, _progress))
+        return nullptr;
+
+    const std::string cache_path = getMeshCachePath(_obj_path, hash);
+    std::shared_ptr<MeshCache> cache = std::make_shared<MeshCache>();
+    if (cache->open(cache_path, hash))
+        return cache;
+
+    Model model;
+    if (!loadObjModel(_obj_path, model, _progress))
+        return nullptr;
+
+    VertexMagnitudes magnitudes;
+    magnitudes.build(model);
+    bool written = !_progress.isCancelled() && MeshCache::write(cache_path, hash, model, magnitudes, _progress);
+    unloadObjModel(model);
+
+    if (!written || !cache->open(cache_path, hash))
+        return nullptr;
+    return cache;
+}
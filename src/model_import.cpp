@@ -0,0 +1,98 @@
+#include "model_import.h"
+#include "obj_loader.h"
+#include "mesh_cache.h"
+#include <cstring>
+
+ModelImport::ModelImport(std::string _obj_file_path, std::string _tex_file_path)
+{
+    this->obj_file_path = _obj_file_path;
+    this->tex_file_path = _tex_file_path;
+    this->uploaded_count = 0;
+    this->image = Image{};
+    this->texture = Texture2D{};
+    this->texture_uploaded = false;
+}
+
+// Frees whatever was not handed over: the CPU copies of meshes never
+// uploaded, and the image if the texture never was.
+ModelImport::~ModelImport()
+{
+    std::vector<Mesh> pending(this->meshes.begin() + this->uploaded_count, this->meshes.end());
+    unloadObjMeshes(pending);
+
+    if (this->image.data)
+        UnloadImage(this->image);
+}
+
+// Goes through the mesh cache, so a model is only parsed the first time.
+// Without a cache (one could not be written) the OBJ is read directly.
+bool ModelImport::parse(JobProgress &_progress)
+{
+    std::shared_ptr<MeshCache> cache = openMeshCache(this->obj_file_path, _progress);
+    if (cache)
+        cache->copyMeshes(this->meshes);
+    else if (_progress.isCancelled() || !loadObjMeshes(this->obj_file_path, this->meshes, _progress))
+        return false;
+
+    this->image = LoadImage(this->tex_file_path.c_str());
+    return !_progress.isCancelled();
+}
+
+bool ModelImport::upload(double _budget_seconds)
+{
+    const double start = GetTime();
+
+    if (!this->texture_uploaded)
+    {
+        this->texture = LoadTextureFromImage(this->image);
+        UnloadImage(this->image);
+        this->image = Image{};
+        this->texture_uploaded = true;
+    }
+
+    do
+    {
+        if (this->uploaded_count == (int)this->meshes.size())
+            return true;
+
+        UploadMesh(&this->meshes[this->uploaded_count], false);
+        this->uploaded_count++;
+    } while (GetTime() - start < _budget_seconds);
+
+    return this->uploaded_count == (int)this->meshes.size();
+}
+
+// Laid out as LoadModel would: one default material shared by every mesh.
+Model ModelImport::takeModel()
+{
+    Model model = {};
+    model.transform = Matrix{1.0f, 0.0f, 0.0f, 0.0f,
+                             0.0f, 1.0f, 0.0f, 0.0f,
+                             0.0f, 0.0f, 1.0f, 0.0f,
+                             0.0f, 0.0f, 0.0f, 1.0f};
+
+    model.meshCount = this->uploaded_count;
+    model.meshes = (Mesh *)RL_CALLOC(model.meshCount, sizeof(Mesh));
+    std::memcpy(model.meshes, this->meshes.data(), model.meshCount * sizeof(Mesh));
+
+    model.materialCount = 1;
+    model.materials = (Material *)RL_CALLOC(1, sizeof(Material));
+    model.materials[0] = LoadMaterialDefault();
+    model.meshMaterial = (int *)RL_CALLOC(model.meshCount, sizeof(int));
+
+    this->meshes.erase(this->meshes.begin(), this->meshes.begin() + this->uploaded_count);
+    this->uploaded_count = 0;
+    return model;
+}
+
+Texture2D ModelImport::takeTexture()
+{
+    Texture2D texture = this->texture;
+    this->texture = Texture2D{};
+    return texture;
+}
+
+const std::string &ModelImport::getObjFilePath()
+{
+    return this->obj_file_path;
+}
@@ -1,30 +1,91 @@
 
 #include "muse.h"
-#include "AudioFile.h"
+#include "raster_scheduler.h"
+#include "thread_pool.h"
+#include "tile_bins.h"
+#include "raster_kernel.h"
+#include "face_cache.h"
+#include "vertex_magnitudes.h"
+#include "buffer_layout.h"
+#include "synth_engine.h"
+#include "wav_writer.h"
+#include "image_export.h"
+#include "image_import.h"
+#include <cstdio>
 #include <iostream>
-#include <thread>
+#include <memory>
+#include <type_traits>
+#include <algorithm>
 #include <cmath>
 #include <limits.h>
 
-Muse::Muse(int _count, std::string _obj_file_path, std::string _tex_file_path)
+Muse::Muse(
+    int _count,
+    Model _model,
+    Texture2D _texture,
+    int _buffer_width,
+    int _buffer_height,
+    SpectrogramFormat _buffer_format)
 {
     this->name = "model_" + std::to_string(++_count);
-    this->model = LoadModel(_obj_file_path.c_str());           // Load model
-    this->model_texture = LoadTexture(_tex_file_path.c_str()); // Load model texture
-    this->model.materials[0].maps[MATERIAL_MAP_DIFFUSE].texture = model_texture;
+    this->model = _model;
+    this->model_texture = _texture;
+    if (this->model.materialCount > 0)
+        this->model.materials[0].maps[MATERIAL_MAP_DIFFUSE].texture = model_texture;
 
-    this->audio_buffer = std::vector<unsigned int>(BUFFER_WIDTH * BUFFER_WIDTH);
-    for (int i = 0; i < (BUFFER_WIDTH * BUFFER_WIDTH); i++)
-    {
-        this->audio_buffer.at(i) = 0;
-    }
+    this->buffer_width = _buffer_width;
+    this->buffer_height = _buffer_height;
+    this->audio_buffer = Spectrogram(_buffer_width, _buffer_height, _buffer_format);
 
     this->buffer_rasterized = false;
+    this->wav_ready = false;
+    this->synthesis_mode = SYNTHESIS_OSCILLATOR_BANK;
+    this->duration = DEFAULT_AUDIO_DURATION;
+    this->sample_rate = DEFAULT_SAMPLE_RATE;
+    this->channels_count = DEFAULT_CHANNELS_COUNT;
+    this->wav_format = DEFAULT_WAV_FORMAT;
+    this->image_format = getBinaryImageFormat(_buffer_format);
 
     this->max_distance_from_origin = 0;
     this->min_distance_from_origin = INT_MAX;
 }
 
+Muse::Muse(
+    int _count,
+    std::shared_ptr<MeshCache> _mesh_cache,
+    int _buffer_width,
+    int _buffer_height,
+    SpectrogramFormat _buffer_format)
+    : Muse(_count, _mesh_cache->getModel(), Texture2D{}, _buffer_width, _buffer_height, _buffer_format)
+{
+    this->mesh_cache = _mesh_cache;
+    this->mesh_cache->getMagnitudes(this->vertex_magnitudes);
+}
+
+Muse::Muse(int _count, std::string _spectrogram_file_path)
+{
+    this->name = "model_" + std::to_string(++_count);
+    this->model = Model{};
+    this->model_texture = Texture2D{};
+
+    this->buffer_width = 0;
+    this->buffer_height = 0;
+
+    this->buffer_rasterized = false;
+    this->wav_ready = false;
+    this->synthesis_mode = SYNTHESIS_OSCILLATOR_BANK;
+    this->duration = DEFAULT_AUDIO_DURATION;
+    this->sample_rate = DEFAULT_SAMPLE_RATE;
+    this->channels_count = DEFAULT_CHANNELS_COUNT;
+    this->wav_format = DEFAULT_WAV_FORMAT;
+    this->image_format = getBinaryImageFormat(DEFAULT_BUFFER_FORMAT);
+
+    this->max_distance_from_origin = 0;
+    this->min_distance_from_origin = INT_MAX;
+
+    importSpectrogram(_spectrogram_file_path);
+}
+
 Muse::~Muse()
 {
     return;
@@ -35,438 +96,482 @@ void Muse::announce(std::string _text)
     std::cout << "Muse \"" << this->name << "\" - " << _text << std::endl;
 }
 
-static void rasterizeOnThread(int _current_thread, int _faces_count, int _threads_count, Muse *_muse)
+void Muse::rasterizeTile(TileBins &_bins, int _tile)
 {
-    int thread_faces_limit = _faces_count / _threads_count;
+    const FaceBounds tile = _bins.getTileBounds(_tile);
+    const FaceCache &faces = this->face_cache;
 
-    for (int face_index = 0; face_index < thread_faces_limit; face_index++)
+    withSampleType(this->audio_buffer.getFormat(), [&](auto _sample)
     {
-        _muse->executePartialRender(_current_thread, thread_faces_limit, face_index);
-    }
-    std::cout << "Finished execution on thread " << _current_thread << std::endl;
+        using T = decltype(_sample);
+        T *buffer = this->audio_buffer.data<T>();
+
+        withBufferLayout(this->buffer_width, [&](auto _layout)
+        {
+            for (const int *face = _bins.tileFacesBegin(_tile); face != _bins.tileFacesEnd(_tile); face++)
+            {
+                RasterVertex L = {faces.u0[*face], faces.v0[*face], faces.m0[*face]};
+                RasterVertex M = {faces.u1[*face], faces.v1[*face], faces.m1[*face]};
+                RasterVertex H = {faces.u2[*face], faces.v2[*face], faces.m2[*face]};
+
+                rasterizeTriangle(L, M, H, tile, buffer, _layout);
+            }
+        });
+    });
 }
 
-void Muse::executePartialRender(int _current_thread, int _thread_faces_limit, int _face_index)
+// Rasterization happens in three stages:
+//
+// 1. the faces of all the model's meshes are cached in buffer space (once
+//    per model),
+// 2. the faces are binned into TILE_SIZE square tiles of the buffer,
+// 3. the tiles are rasterized on the thread pool, each by a single worker
+//    walking its faces in face index order.
+//
+// As no two workers ever write the same pixel and every pixel sees its faces
+// in the same order as a plain loop over all meshes and faces would, the buffer is
+// bit-identical to a single-threaded rasterization, whatever the number of
+// threads.
+void Muse::rasterizeBuffer()
 {
-    std::vector<unsigned int> face;
-    populateFaceRasterData(face, (_current_thread * _thread_faces_limit) + _face_index);
+    JobProgress progress;
+    rasterizeBuffer(progress);
+}
 
-    for (auto each : face)
+// Progress is counted in faces, once for every tile a face is binned to.
+// A cancelled rasterization leaves the buffer marked unrasterized.
+void Muse::rasterizeBuffer(JobProgress &_progress)
+{
+    if (this->model.meshCount == 0)
     {
-        if (each >= BUFFER_WIDTH)
-            return;
+        announce("Nothing to rasterize, the muse has no model.");
+        return;
     }
 
-    orderFace(face);
-    rasterizeFace(face);
-}
-
-void Muse::rasterizeBuffer()
-{
     initMinMaxValues();
 
     std::cout << "min: " << this->min_distance_from_origin << std::endl;
     std::cout << "max: " << this->max_distance_from_origin << std::endl;
     std::cout << "diff: " << this->min_max_distance_difference << std::endl;
 
-    const Mesh raster_mesh = this->model.meshes[0];
-    const int faces_count = raster_mesh.triangleCount;
-
-    std::cout << "verticies: " << raster_mesh.vertexCount << std::endl;
-    std::cout << "triangles: " << raster_mesh.triangleCount << std::endl;
-
-    const static int threads_count = std::thread::hardware_concurrency();
-    std::thread t[threads_count];
+    std::cout << "meshes: " << this->model.meshCount << std::endl;
+    std::cout << "verticies: " << getVertexCount() << std::endl;
+    std::cout << "triangles: " << getTriangleCount() << std::endl;
 
-    std::cout << "threads: " << threads_count << std::endl;
-    std::cout << "starting threads" << std::endl;
+    int magnitude_max = 0;
+    withSampleType(this->audio_buffer.getFormat(), [&](auto _sample)
+    {
+        magnitude_max = SampleTraits<decltype(_sample)>::magnitude_max;
+    });
 
-    for (int i = 0; i < threads_count; i++)
+    if (this->face_cache.empty())
     {
-        std::cout << "executing thread: " << i << std::endl;
-        t[i] = std::thread(rasterizeOnThread, i, faces_count, threads_count, this);
+        this->face_cache.build(
+            this->model,
+            this->vertex_magnitudes,
+            this->buffer_width,
+            this->buffer_height,
+            this->min_distance_from_origin,
+            this->min_max_distance_difference,
+            magnitude_max);
     }
 
-    for (int i = 0; i < threads_count; i++)
+    std::cout << "cached faces: " << this->face_cache.size()
+              << " (" << this->face_cache.getRejectedCount() << " rejected)" << std::endl;
+
+    std::vector<FaceBounds> face_bounds(this->face_cache.size());
+    for (int face = 0; face < this->face_cache.size(); face++)
     {
-        t[i].join();
-        std::cout << "thread " << std::to_string(i) << " finished." << std::endl;
+        face_bounds[face] = this->face_cache.getBounds(face);
     }
 
-    this->buffer_rasterized = true;
-}
+    TileBins bins(this->buffer_width, this->buffer_height, TILE_SIZE);
+    bins.build(face_bounds);
 
-float Muse::getVertexDistance(std::tuple<float, float, float> vertex)
-{
-    return std::sqrt(std::pow(std::get<0>(vertex), 2) +
-                     std::pow(std::get<1>(vertex), 2) +
-                     std::pow(std::get<2>(vertex), 2));
-}
+    RasterScheduler scheduler(bins.getTileWeights(), ThreadPool::instance().getThreadsCount());
 
-void Muse::initMinMaxValues()
-{
-    for (int i = 0; i < this->model.meshes[0].vertexCount; i++)
-    {
-        std::tuple<float, float, float> vertex{
-            this->model.meshes[0].vertices[(i * 3) + 0],
-            this->model.meshes[0].vertices[(i * 3) + 1],
-            this->model.meshes[0].vertices[(i * 3) + 2],
-        };
+    std::cout << "threads: " << scheduler.getThreadsCount() << std::endl;
+    std::cout << "span writer: " << getSpanWriterName(getSpanWriterLevel()) << std::endl;
+    std::cout << "buffer: " << this->buffer_width << "x" << this->buffer_height
+              << ", " << this->audio_buffer.getByteSize() << " bytes" << std::endl;
+    std::cout << "tiles: " << bins.getTilesCount() << std::endl;
+    std::cout << "chunks: " << scheduler.getChunksCount() << std::endl;
 
-        float vertex_distance = getVertexDistance(vertex);
+    this->buffer_rasterized = false;
 
-        std::cout << "vertex distance: " << vertex_distance << std::endl;
+    int64_t binned_faces = 0;
+    for (int tile = 0; tile < bins.getTilesCount(); tile++)
+    {
+        binned_faces += bins.tileFacesEnd(tile) - bins.tileFacesBegin(tile);
+    }
+    _progress.start(binned_faces);
 
-        // set min max accordingly
-        if (vertex_distance < this->min_distance_from_origin)
-        {
-            this->min_distance_from_origin = vertex_distance;
-        }
-        if (vertex_distance > this->max_distance_from_origin)
+    scheduler.run([this, &bins, &_progress](int _begin, int _end)
+    {
+        for (int tile = _begin; tile < _end && !_progress.isCancelled(); tile++)
         {
-            this->max_distance_from_origin = vertex_distance;
+            rasterizeTile(bins, tile);
+            _progress.advance(bins.tileFacesEnd(tile) - bins.tileFacesBegin(tile));
         }
+    });
 
-        // set min max difference accordingly
-        this->min_max_distance_difference =
-            this->max_distance_from_origin - this->min_distance_from_origin;
+    if (_progress.isCancelled())
+    {
+        announce("Rasterization cancelled.");
+        return;
     }
-}
 
-void Muse::populateFaceRasterData(std::vector<unsigned int> &_face, int _face_index)
-{
-    // first point
-    _face.push_back(getFaceX1(_face_index));
-    _face.push_back(getFaceY1(_face_index));
-    _face.push_back(getFaceZ1(_face_index));
+    std::vector<ThreadStats> thread_stats = scheduler.getThreadStats();
+    for (int i = 0; i < (int)thread_stats.size(); i++)
+    {
+        std::cout << "thread " << i
+                  << ": tiles " << thread_stats[i].items
+                  << ", chunks " << thread_stats[i].chunks
+                  << " (" << thread_stats[i].stolen_chunks << " stolen)"
+                  << ", busy " << thread_stats[i].busy_ms << " ms"
+                  << ", idle " << thread_stats[i].idle_ms << " ms" << std::endl;
+    }
 
-    // second point
-    _face.push_back(getFaceX2(_face_index));
-    _face.push_back(getFaceY2(_face_index));
-    _face.push_back(getFaceZ2(_face_index));
+    buildActiveRows();
 
-    // third point
-    _face.push_back(getFaceX3(_face_index));
-    _face.push_back(getFaceY3(_face_index));
-    _face.push_back(getFaceZ3(_face_index));
+    this->buffer_rasterized = true;
 }
 
-unsigned int Muse::getFaceX1(int _face_index)
+// Indexes the non-zero rows of every column for synthesis, and reports how
+// sparse the spectrogram is. Synthesis cost scales with the active cells,
+// so rows / mean active rows is roughly the speedup over visiting them all.
+void Muse::buildActiveRows()
 {
-    return getCoordinateValue(1, 1, _face_index);
-}
+    this->active_rows.build(this->audio_buffer);
 
-unsigned int Muse::getFaceY1(int _face_index)
-{
-    return getCoordinateValue(1, 2, _face_index);
-}
+    SparsityStats stats = this->active_rows.getStats();
+    double density = stats.cells ? (double)stats.active_cells / stats.cells : 0.0;
 
-unsigned int Muse::getFaceZ1(int _face_index)
-{
-    return getColorValue(1, _face_index);
+    std::cout << "active cells: " << stats.active_cells << " of " << stats.cells
+              << " (" << (100.0 * density) << "%)" << std::endl;
+    std::cout << "active rows per column: mean " << stats.mean_column_rows
+              << ", max " << stats.max_column_rows
+              << ", " << stats.empty_columns << " empty columns" << std::endl;
+    if (stats.active_cells > 0)
+        std::cout << "expected synthesis speedup: " << (1.0 / density) << "x" << std::endl;
 }
 
-unsigned int Muse::getFaceX2(int _face_index)
+// Measures every vertex of every mesh once (see VertexMagnitudes) and keeps
+// the distance range used to normalize magnitudes, shared by all meshes.
+void Muse::initMinMaxValues()
 {
-    return getCoordinateValue(2, 1, _face_index);
-}
+    if (this->vertex_magnitudes.empty())
+    {
+        this->vertex_magnitudes.build(this->model);
+    }
 
-unsigned int Muse::getFaceY2(int _face_index)
-{
-    return getCoordinateValue(2, 2, _face_index);
+    this->min_distance_from_origin = this->vertex_magnitudes.min_distance;
+    this->max_distance_from_origin = this->vertex_magnitudes.max_distance;
+    this->min_max_distance_difference =
+        this->max_distance_from_origin - this->min_distance_from_origin;
 }
 
-unsigned int Muse::getFaceZ2(int _face_index)
+// Exported files go to the working directory unless _filename is an
+// absolute path.
+static std::string getExportPath(const std::string &_filename, const char *_extension)
 {
-    return getColorValue(2, _face_index);
+    std::string prefix = (!_filename.empty() && _filename[0] == '/') ? "" : "./";
+    return prefix + _filename + _extension;
 }
 
-unsigned int Muse::getFaceX3(int _face_index)
+bool Muse::exportImage(std::string _filename)
 {
-    return getCoordinateValue(3, 1, _face_index);
+    JobProgress progress;
+    return exportImage(_filename, progress);
 }
 
-unsigned int Muse::getFaceY3(int _face_index)
+// Progress is counted in rows. A cancelled export writes nothing.
+bool Muse::exportImage(std::string _filename, JobProgress &_progress)
 {
-    return getCoordinateValue(3, 2, _face_index);
-}
+    std::string _file_path = getExportPath(_filename, getImageExtension(this->image_format));
+    std::cout << "Creating image file at " << _file_path << "." << std::endl;
 
-unsigned int Muse::getFaceZ3(int _face_index)
-{
-    return getColorValue(3, _face_index);
+    if (!writeImage(_file_path, this->audio_buffer, this->image_format, _progress))
+    {
+        if (_progress.isCancelled())
+            announce("Image export cancelled.");
+        else
+            announce("Could not write \"" + _file_path + "\".");
+        return false;
+    }
+    return true;
 }
 
-unsigned int Muse::getCoordinateValue(int _point_index, int _dimension_index, int _face_index)
+// Replaces the spectrogram with the one stored at _file_path, taking its
+// size and element type, so audio can be rendered without rasterizing.
+// Large files are mapped rather than read (see MappedFile).
+bool Muse::importSpectrogram(std::string _file_path)
 {
-    return (this->model.meshes[0].texcoords[(_face_index * 6) + ((_point_index - 1) * 2) + (_dimension_index - 1)]) * BUFFER_WIDTH;
-}
+    std::cout << "Reading spectrogram from " << _file_path << "." << std::endl;
 
-float Muse::calculateRealMagnitude(float _temp_raw_mag)
-{
-    return (_temp_raw_mag - this->min_distance_from_origin) /
-           this->min_max_distance_difference;
-}
+    Spectrogram spectrogram;
+    if (!readImage(_file_path, spectrogram))
+    {
+        announce("Could not read a spectrogram from \"" + _file_path + "\".");
+        return false;
+    }
 
-unsigned int Muse::getColorValue(int _point_index, int _face_index)
-{
-    std::tuple<float, float, float> vertex = {
-        this->model.meshes[0].vertices[(_face_index * 9) + ((_point_index - 1) * 3) + 0],
-        this->model.meshes[0].vertices[(_face_index * 9) + ((_point_index - 1) * 3) + 1],
-        this->model.meshes[0].vertices[(_face_index * 9) + ((_point_index - 1) * 3) + 2]};
+    this->audio_buffer = std::move(spectrogram);
+    this->buffer_width = this->audio_buffer.getWidth();
+    this->buffer_height = this->audio_buffer.getHeight();
+    this->image_format = getBinaryImageFormat(this->audio_buffer.getFormat());
+    this->wav_ready = false;
 
-    float temp_raw_mag = this->getVertexDistance(vertex);
-    float temp_real_mag = this->calculateRealMagnitude(temp_raw_mag);
-    float color_magnitude = 255 * temp_real_mag;
+    // Cached faces were placed for the old buffer size.
+    this->face_cache = FaceCache();
 
-    if ((color_magnitude < 0) || (color_magnitude > 255))
-    {
-        std::cout << "error" << std::endl;
-    }
+    std::cout << "buffer: " << this->buffer_width << "x" << this->buffer_height
+              << ", " << this->audio_buffer.getByteSize() << " bytes" << std::endl;
+
+    buildActiveRows();
 
-    return (unsigned int)color_magnitude;
+    this->buffer_rasterized = true;
+    return true;
 }
 
-void Muse::orderFace(std::vector<unsigned int> &_face_data)
+// Copies the active cells of the normalized spectrogram (see ActiveRows),
+// scaled by _gain, into _engine, in parallel on the thread pool.
+template <typename Engine>
+void Muse::loadColumns(Engine &_engine, double _gain)
 {
-    if (_face_data[1] > _face_data[4])
-    {
-        std::swap(_face_data[0], _face_data[3]);
-        std::swap(_face_data[1], _face_data[4]);
-        std::swap(_face_data[2], _face_data[5]);
-    }
+    const int columns_per_band = 64;
 
-    if (_face_data[4] > _face_data[7])
+    TaskGroup loaders;
+    for (int band_start = 0; band_start < this->buffer_width; band_start += columns_per_band)
     {
-        std::swap(_face_data[3], _face_data[6]);
-        std::swap(_face_data[4], _face_data[7]);
-        std::swap(_face_data[5], _face_data[8]);
+        loaders.run([this, band_start, columns_per_band, _gain, &_engine]()
+        {
+            withSampleType(this->audio_buffer.getFormat(), [&](auto _sample)
+            {
+                const auto *audio_samples = this->audio_buffer.data<decltype(_sample)>();
+
+                withBufferLayout(this->buffer_width, [&](auto _layout)
+                {
+                    int band_end = std::min(this->buffer_width, band_start + columns_per_band);
+                    for (int column = band_start; column < band_end; column++)
+                    {
+                        float *amplitudes = _engine.getAmplitudes(column);
+                        const int *rows = this->active_rows.columnRowsBegin(column);
+                        const int active_count = this->active_rows.columnRowsCount(column);
+                        for (int i = 0; i < active_count; i++)
+                        {
+                            amplitudes[i] = Amplitude(audio_samples, _layout, rows[i], column) * _gain;
+                        }
+                    }
+                });
+            });
+        });
     }
+    loaders.wait();
+}
+
+// Renders _engine chunk by chunk into _writer. Only one chunk of samples
+// is ever held, whatever the duration. Stops between chunks if cancelled.
+template <typename Engine>
+bool Muse::streamAudio(const Engine &_engine, WavWriter &_writer, JobProgress &_progress)
+{
+    const int64_t samples_count = _engine.getSamplesCount();
+    std::vector<float> chunk(std::min<int64_t>(AUDIO_CHUNK_SAMPLES, samples_count));
 
-    if (_face_data[1] > _face_data[4])
+    for (int64_t chunk_start = 0; chunk_start < samples_count; chunk_start += AUDIO_CHUNK_SAMPLES)
     {
-        std::swap(_face_data[0], _face_data[3]);
-        std::swap(_face_data[1], _face_data[4]);
-        std::swap(_face_data[2], _face_data[5]);
+        const int64_t chunk_count = std::min<int64_t>(AUDIO_CHUNK_SAMPLES, samples_count - chunk_start);
+        if (_progress.isCancelled())
+            return false;
+
+        _engine.render(chunk_start, chunk_count, chunk.data());
+        if (!_writer.writeMono(chunk.data(), chunk_count))
+            return false;
+        _progress.advance(chunk_count);
     }
+    return true;
 }
 
-void Muse::rasterizeFace(std::vector<unsigned int> &face)
+// Builds the engine of the current synthesis mode over _active_rows, loads
+// it with the spectrogram's amplitudes, and hands it to _visit.
+template <typename Visitor>
+void Muse::withSynthesisEngine(const ActiveRows &_active_rows, int64_t _samples_count, Visitor _visit)
 {
-    Point L = std::make_tuple(face[0], face[1], face[2]);
-    Point M = std::make_tuple(face[3], face[4], face[5]);
-    Point H = std::make_tuple(face[6], face[7], face[8]);
+    const double gain = DECIBLE_SCALAR / GetHertzRange();
 
-    // none of the color values should be greater than 255.
-    if ((std::get<2>(L) > 255) ||
-        (std::get<2>(M) > 255) ||
-        (std::get<2>(H) > 255))
+    switch (this->synthesis_mode)
+    {
+    case SYNTHESIS_INVERSE_FFT:
+    {
+        // Every column is one frame, rendered by an OverlapAddEngine.
+        const int fft_size = getFftSize(_samples_count);
+        OverlapAddEngine engine(getRowBins(fft_size), fft_size, _active_rows, _samples_count);
+        loadColumns(engine, gain);
+        _visit(engine);
+        break;
+    }
+    default:
     {
-        std::cout << "error" << std::endl;
+        // The summing is done by a SynthEngine, one oscillator per row.
+        SynthEngine engine(getRowFrequencies(), _active_rows, _samples_count);
+        loadColumns(engine, gain);
+        _visit(engine);
+        break;
     }
+    }
+}
 
-    this->rasterizeTop(L, M, H);
-    this->rasterizeBottom(L, M, H);
+bool Muse::exportAudio(std::string _filename)
+{
+    JobProgress progress;
+    return exportAudio(_filename, progress);
 }
 
-void Muse::rasterizeTop(Point &L, Point &M, Point &H)
+// Progress is counted in samples per channel. A cancelled export removes
+// the partly written file.
+bool Muse::exportAudio(std::string _filename, JobProgress &_progress)
 {
-    float m_a = slope(H, L);
-    float b_a = yIntercept(m_a, H);
+    // Because the Muse's audio buffer is a vector we are conceptually
+    // treating as a 2D array, we will need to step sideways across the buffer
+    // in the X direction, aggregating the herz and their magnitudes for each
+    // row along the Y axis for each sample in question. The final aggregated
+    // total for each sample becomes the sample value at that step.
 
-    float m_b = slope(H, M);
-    float b_b = yIntercept(m_b, H);
+    // Only rows with a magnitude are synthesized.
+    if (this->active_rows.empty())
+    {
+        buildActiveRows();
+    }
 
-    for (int omega = std::get<1>(M); omega < std::get<1>(H); omega++)
+    std::string file_path = getExportPath(_filename, ".wav");
+    WavWriter writer;
+    if (!writer.open(file_path, this->sample_rate, this->channels_count, this->wav_format))
     {
-        float A_y = omega;
-        float A_x = (!std::isinf(m_a) && m_a != 0) ? xIntercept(omega, b_a, m_a) : std::get<0>(H);
-        float A_z = interpolate(A_x, A_y, H, L);
+        announce("Could not create \"" + file_path + "\".");
+        return false;
+    }
 
-        Point A = std::make_tuple(A_x, A_y, A_z);
+    _progress.start(getSamplesCount());
 
-        float B_y = omega;
-        float B_x = (!std::isinf(m_b) && m_b != 0) ? xIntercept(omega, b_b, m_b) : std::get<0>(M);
-        float B_z = interpolate(B_x, B_y, H, M);
+    bool written = false;
+    withSynthesisEngine(this->active_rows, getSamplesCount(), [&](auto &_engine)
+    {
+        written = streamAudio(_engine, writer, _progress);
+    });
 
-        Point B = std::make_tuple(B_x, B_y, B_z);
+    if (_progress.isCancelled())
+    {
+        writer.close();
+        std::remove(file_path.c_str());
+        announce("Audio export cancelled.");
+        return false;
+    }
 
-        rasterizeLine(omega, A, B);
+    if (!writer.close() || !written)
+    {
+        announce("Could not write \"" + file_path + "\".");
+        return false;
     }
+
+    this->wav_ready = true;
+    return true;
 }
 
-void Muse::rasterizeBottom(Point &L, Point &M, Point &H)
+// The whole signal as a function of sample position, for playback (see
+// AudioPlayer::Renderer). The engine is built once, up front.
+Muse::AudioRenderer Muse::makeRenderer()
 {
-    float m_a = slope(H, L);
-    float b_a = yIntercept(m_a, H);
-
-    float m_b = slope(L, M);
-    float b_b = yIntercept(m_b, L);
-
-    for (int omega = std::get<1>(M); omega > std::get<1>(L); omega--)
+    if (this->active_rows.empty())
     {
-        float A_y = omega;
-        float A_x = (!std::isinf(m_a) && m_a != 0) ? xIntercept(omega, b_a, m_a) : std::get<0>(L);
-        float A_z = interpolate(A_x, A_y, H, L);
-
-        Point A = std::make_tuple(A_x, A_y, A_z);
-
-        float B_y = omega;
-        float B_x = (!std::isinf(m_b) && m_b != 0) ? xIntercept(omega, b_b, m_b) : std::get<0>(M);
-        float B_z = interpolate(B_x, B_y, L, M);
-
-        Point B = std::make_tuple(B_x, B_y, B_z);
-
-        rasterizeLine(omega, A, B);
+        buildActiveRows();
     }
-}
 
-float Muse::slope(Point &_u, Point &_v)
-{
-    return (std::get<1>(_u) - std::get<1>(_v)) /
-           (std::get<0>(_u) - std::get<0>(_v));
-}
+    // Playback outlives this call, and may outlive the next rasterization,
+    // so the engine gets its own copy of the index.
+    auto active_rows = std::make_shared<ActiveRows>(this->active_rows);
+    AudioRenderer render;
 
-float Muse::yIntercept(float _m, Point &_u)
-{
-    // _u.y - (m * _u.x)
-    return std::get<1>(_u) - (_m * std::get<0>(_u));
-}
+    withSynthesisEngine(*active_rows, getSamplesCount(), [&](auto &_engine)
+    {
+        using Engine = std::decay_t<decltype(_engine)>;
+        auto engine = std::make_shared<Engine>(std::move(_engine));
 
-float Muse::xIntercept(int &_y, float &_b, float &_m)
-{
-    return (_y - _b) / _m;
-}
+        render = [engine, active_rows](int64_t _begin, int64_t _count, float *_out)
+        {
+            engine->render(_begin, _count, _out);
+        };
+    });
 
-float Muse::interpolate(
-    float _curr_x,
-    float _curr_y,
-    Point &_a_bound,
-    Point &_b_bound)
-{
-    float color_difference = (std::get<2>(_b_bound) - std::get<2>(_a_bound));
-    float progress = this->distance2d(
-        _curr_x,
-        _curr_y,
-        std::get<0>(_a_bound),
-        std::get<1>(_a_bound));
-    float whole = this->distance2d(
-        std::get<0>(_b_bound),
-        std::get<1>(_b_bound),
-        std::get<0>(_a_bound),
-        std::get<1>(_a_bound));
-    float ratio = progress / whole;
-    return std::get<2>(_a_bound) + (color_difference * ratio);
+    return render;
 }
 
-float Muse::distance2d(float _x1, float _y1, float _x2, float _y2)
+// Length of exported audio in samples per channel.
+int64_t Muse::getSamplesCount()
 {
-    float square_x = std::pow((_x1 - _x2), 2);
-    float square_y = std::pow((_y1 - _y2), 2);
-    return std::sqrt(square_x + square_y);
+    return std::max<int64_t>(1, std::llround(this->duration * this->sample_rate));
 }
 
-void Muse::rasterizeLine(int omega, Point &A, Point &B)
+// Angular frequency, in radians per sample, of every row's oscillator.
+//
+// Row frequencies grow quadratically: each row adds hertz_step times its
+// index to the one before, starting from MIN_HERTZ. The values are used
+// as radians per sample, as the original sample loop did.
+std::vector<double> Muse::getRowFrequencies()
 {
-    if (std::get<0>(A) > std::get<0>(B))
-    {
-        std::swap(A, B);
-    }
+    std::vector<double> frequencies(this->buffer_height);
 
-    for (int i = std::get<0>(A); i < (std::get<0>(B) + 1); i++)
-    {
-        float T_x = i;
-        float T_y = omega;
-        float T_z = this->interpolate(T_x, T_y, A, B);
+    int hertz_step = GetHertzRange() / this->buffer_height;
+    int64_t frequency = MIN_HERTZ;
 
-        this->audio_buffer.at((T_y * BUFFER_WIDTH) + T_x) = T_z;
+    for (int row = 0; row < this->buffer_height; row++)
+    {
+        frequency += (int64_t)hertz_step * row;
+        frequencies[row] = frequency;
     }
+    return frequencies;
 }
 
-void Muse::exportImage(std::string _filename)
+// Locals rather than statics, so several muses can synthesize at once.
+double Muse::Frequency(const int &row)
 {
-    std::string _file_path = "./" + _filename + ".ppm";
-    std::cout << "Creating image file at " << _file_path << "." << std::endl;
+    double hertz_range = GetHertzRange();
+    double row_height_ratio = double(row) / this->buffer_height;
+    double base_frequency = hertz_range * row_height_ratio;
+    double adjusted_frequency = base_frequency + MIN_HERTZ;
 
-    std::ofstream image_file(_file_path);
-    image_file << "P2\n";
-    image_file << BUFFER_WIDTH << " " << BUFFER_WIDTH << "\n";
-    image_file << "255\n";
-
-    for (int y = 0; y < BUFFER_WIDTH; y++)
-    {
-        for (int x = 0; x < BUFFER_WIDTH; x++)
-        {
-            image_file << int(audio_buffer.at((y * BUFFER_WIDTH) + x)) << " ";
-        }
-        image_file << std::endl;
-    }
-    image_file.close();
+    return adjusted_frequency;
 }
 
-void Muse::exportAudio(std::string _filename)
+// Transform size for SYNTHESIS_INVERSE_FFT: the smallest power of two
+// that gives every row its own bin between MIN_HERTZ and MAX_HERTZ and
+// spans at least two columns of _samples_count samples, so frames overlap.
+int Muse::getFftSize(int64_t _samples_count)
 {
-    AudioFile<double>::AudioBuffer buffer;
+    int64_t bins_needed = std::ceil(this->buffer_height * (double)this->sample_rate / GetHertzRange());
+    int64_t hop = (_samples_count + this->buffer_width - 1) / this->buffer_width;
+    int64_t frame_needed = std::max<int64_t>(bins_needed, 2 * hop);
 
-    // create buffer channels
-    int numChannels = 1;
-    buffer.resize(numChannels);
-
-    // define sample size for each channel
-    int numSamplesPerChannel = 44100;
-    buffer[0].resize(numSamplesPerChannel); // samples = buffer[0]
-
-    int hertz_step = GetHertzRange() / BUFFER_WIDTH;
-
-    // Because the Muse's audio buffer is a vector we are conceptually
-    // treating as a 2D array, we will need to step sideways across the buffer
-    // in the X direction, aggregating the herz and their magnitudes for each
-    // sample_herz_index along the Y axis for each sample_step in question.
-    // The final aggregated total for each sample_step becomes the sample value at that step.
-
-    for (int sample_step = 0; sample_step < numSamplesPerChannel; sample_step++)
+    int fft_size = 2;
+    while (fft_size < frame_needed)
     {
-        // For each sample, reset values.
-        double sample_value = 0.0;
-        int frequency = MIN_HERTZ;
-
-        // Iterate 'vertically' along the buffer column at this sample_step to sum all of the
-        // hertz values and their magnitudes.
-        for (int sample_herz_index = 0; sample_herz_index < BUFFER_WIDTH; sample_herz_index++)
-        {
-            // Get the herz  (double value 0.0 - 1.0).
-            double amplitude = Amplitude(sample_herz_index, sample_step, numSamplesPerChannel);
-
-            // The current frequency should be a sum of the hertz_step value across the herz iterator.
-            frequency += hertz_step * sample_herz_index;
-
-            sample_value += (amplitude * sinf(frequency * sample_step)) / GetHertzRange();
-        }
-
-        buffer[0][sample_step] = sample_value * DECIBLE_SCALAR;
+        fft_size *= 2;
     }
-
-    AudioFile<double> audioFile;
-    audioFile.setAudioBuffer(buffer);
-
-    std::string file_path = "./" + _filename + ".wav";
-    audioFile.save(file_path, AudioFileFormat::Wave);
-
-    this->wav_ready = true;
+    return fft_size;
 }
 
-double Muse::Frequency(const int &row)
+// FFT bin of every row in a _fft_size point transform, for
+// SYNTHESIS_INVERSE_FFT: rows are spread linearly from MIN_HERTZ to
+// MAX_HERTZ (see Frequency).
+std::vector<int> Muse::getRowBins(int _fft_size)
 {
-    static double hertz_range;
-    static double row_height_ratio;
-    static double base_frequency;
-    static double adjusted_frequency;
-
-    hertz_range = GetHertzRange();
-    row_height_ratio = double(row) / BUFFER_WIDTH;
-    base_frequency = hertz_range * row_height_ratio;
-    adjusted_frequency = base_frequency + MIN_HERTZ;
+    std::vector<int> bins(this->buffer_height);
 
-    return adjusted_frequency;
+    for (int row = 0; row < this->buffer_height; row++)
+    {
+        long bin = std::lround(Frequency(row) * _fft_size / this->sample_rate);
+        bins[row] = std::min(std::max(bin, 1L), (long)(_fft_size / 2) - 1);
+    }
+    return bins;
 }
 
 double Muse::GetHertzRange()
@@ -474,8 +579,8 @@ double Muse::GetHertzRange()
     return (MAX_HERTZ - MIN_HERTZ);
 }
 
-// Given the sample step iterator of the audio buffer, and an iterator for each herz index
-// along the column for that sample, get the float value at that corresponds.
+// Given a column of the audio buffer, and an iterator for each herz index
+// along that column, get the float value at that corresponds.
 //
 // e.g. 255,  122,  143,  123,  139,   <-- audio buffer of 15 values displayed as a
 //      13,   0,    0,    16,   54,       2 dimensional buffer with a buffer width of
@@ -489,20 +594,18 @@ double Muse::GetHertzRange()
 //      So our audio sine wave is a combination of three Hz, 5k, 10k, and 20k. The Amplitude
 //      of 10k Hz in the first sample is 13 divided by a threshold of 255.
 //
-double Muse::Amplitude(const int &herz_iterator, const int &sample_index, int numSamplesPerChannel)
+template <typename T, typename Layout>
+double Muse::Amplitude(const T *_buffer, const Layout &_layout, const int &herz_iterator, const int &column)
 {
-    static int audio_buffer_x, audio_buffer_y;
-    static double true_amplitude;
-    static double normalized_amplitude;
-
-    audio_buffer_x = (sample_index * BUFFER_WIDTH) / numSamplesPerChannel;
-    audio_buffer_y = herz_iterator;
+    // Locals rather than statics, as columns are loaded concurrently.
+    int audio_buffer_x = column;
+    int audio_buffer_y = herz_iterator;
 
-    // Gets a 0-254 unsigned int from the audio buffer.
-    true_amplitude = audio_buffer.at((audio_buffer_y * BUFFER_WIDTH) + audio_buffer_x);
+    // Gets the stored magnitude from the audio buffer.
+    double true_amplitude = _buffer[_layout.index(audio_buffer_x, audio_buffer_y)];
 
     // Convert the value to a 0.0 - 1.0 float value.
-    normalized_amplitude = (true_amplitude / 255);
+    double normalized_amplitude = (true_amplitude / SampleTraits<T>::max_value);
 
     return normalized_amplitude;
 }
@@ -522,11 +625,109 @@ Texture2D Muse::getTexture()
     return this->model_texture;
 }
 
-std::vector<unsigned int> Muse::getAudioBuffer()
+const Spectrogram &Muse::getAudioBuffer()
 {
     return this->audio_buffer;
 }
 
+int Muse::getVertexCount()
+{
+    int vertex_count = 0;
+    for (int mesh = 0; mesh < this->model.meshCount; mesh++)
+    {
+        vertex_count += this->model.meshes[mesh].vertexCount;
+    }
+    return vertex_count;
+}
+
+int Muse::getTriangleCount()
+{
+    int triangle_count = 0;
+    for (int mesh = 0; mesh < this->model.meshCount; mesh++)
+    {
+        triangle_count += this->model.meshes[mesh].triangleCount;
+    }
+    return triangle_count;
+}
+
+int Muse::getBufferWidth()
+{
+    return this->buffer_width;
+}
+
+int Muse::getBufferHeight()
+{
+    return this->buffer_height;
+}
+
+SpectrogramFormat Muse::getBufferFormat()
+{
+    return this->audio_buffer.getFormat();
+}
+
+SynthesisMode Muse::getSynthesisMode()
+{
+    return this->synthesis_mode;
+}
+
+void Muse::setSynthesisMode(SynthesisMode _mode)
+{
+    this->synthesis_mode = _mode;
+}
+
+double Muse::getDuration()
+{
+    return this->duration;
+}
+
+// Seconds of audio exportAudio renders, spreading the columns over them.
+void Muse::setDuration(double _seconds)
+{
+    this->duration = std::max(_seconds, 0.0);
+}
+
+int Muse::getSampleRate()
+{
+    return this->sample_rate;
+}
+
+void Muse::setSampleRate(int _sample_rate)
+{
+    this->sample_rate = std::max(_sample_rate, 1);
+}
+
+int Muse::getChannelsCount()
+{
+    return this->channels_count;
+}
+
+// Every channel carries the same signal.
+void Muse::setChannelsCount(int _channels_count)
+{
+    this->channels_count = std::max(_channels_count, 1);
+}
+
+ImageFileFormat Muse::getImageFormat()
+{
+    return this->image_format;
+}
+
+// Defaults to the binary PGM that holds the buffer's precision.
+void Muse::setImageFormat(ImageFileFormat _format)
+{
+    this->image_format = _format;
+}
+
+WavSampleFormat Muse::getWavFormat()
+{
+    return this->wav_format;
+}
+
+void Muse::setWavFormat(WavSampleFormat _format)
+{
+    this->wav_format = _format;
+}
+
 bool Muse::bufferReady()
 {
     return this->buffer_rasterized;
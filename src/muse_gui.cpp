@@ -0,0 +1,28 @@
+
+#include "muse.h"
+#include "play_audio.h"
+
+// The parts of Muse that need a window, a GL context or the audio device.
+// They are built into the muser binary only, so muser-core and muser-cli
+// never reference raylib's window, GL or audio functions.
+
+Muse::Muse(
+    int _count,
+    std::string _obj_file_path,
+    std::string _tex_file_path,
+    int _buffer_width,
+    int _buffer_height,
+    SpectrogramFormat _buffer_format)
+    : Muse(_count,
+           LoadModel(_obj_file_path.c_str()),   // Load model
+           LoadTexture(_tex_file_path.c_str()), // Load model texture
+           _buffer_width,
+           _buffer_height,
+           _buffer_format)
+{
+}
+
+void Muse::play()
+{
+    AudioPlayer::instance().play(makeRenderer(), getSamplesCount(), this->sample_rate, this->channels_count);
+}
@@ -0,0 +1,492 @@
+#include "obj_loader.h"
+#include "mapped_file.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <map>
+
+// Bytes of the file parsed per pool task, rounded up to the next line.
+static const size_t PARSE_CHUNK_BYTES = 4 << 20;
+
+// What one chunk of lines holds, indices not yet resolved.
+//
+// Corner indices are 0-based, -1 when absent. Negative (relative) OBJ
+// indices are stored relative to the chunk's own first element, possibly
+// below zero, and their slots listed in relative_corners, so they can be
+// made absolute once the counts of earlier chunks are known.
+struct ObjChunk
+{
+    std::vector<float> positions;
+    std::vector<float> texcoords;
+    std::vector<float> normals;
+    std::vector<int> corners; // Position, texcoord, normal; three per triangle.
+    std::vector<size_t> relative_corners;
+    // usemtl lines: triangles read before each, and the material name.
+    std::vector<std::pair<int, std::string>> materials;
+    std::vector<int> material_ids;
+    bool failed = false;
+};
+
+// The whole file, once the chunks are joined.
+struct ObjData
+{
+    std::vector<float> positions;
+    std::vector<float> texcoords;
+    std::vector<float> normals;
+    std::vector<int> corners;
+    std::vector<int> face_materials;
+    int materials_count = 1;
+};
+
+static const char *skipBlanks(const char *_at, const char *_end)
+{
+    while (_at < _end && (*_at == ' ' || *_at == '\t'))
+        _at++;
+    return _at;
+}
+
+// Reads _count floats, zeros for any that are missing or malformed.
+static void readFloats(const char *_at, const char *_end, int _count, std::vector<float> &_out)
+{
+    for (int i = 0; i < _count; i++)
+    {
+        _at = skipBlanks(_at, _end);
+        float value = 0.0f;
+        auto result = std::from_chars(_at, _end, value);
+        if (result.ec == std::errc())
+            _at = result.ptr;
+        _out.push_back(value);
+    }
+}
+
+// Reads one index of a corner. _count is how many elements of its kind
+// the chunk has read so far, for relative indices.
+static bool readIndex(const char *&_at, const char *_end, size_t _count, ObjChunk &_chunk)
+{
+    long index = 0;
+    auto result = std::from_chars(_at, _end, index);
+    if (result.ec != std::errc() || index == 0)
+        return false;
+    _at = result.ptr;
+
+    if (index < 0)
+    {
+        _chunk.relative_corners.push_back(_chunk.corners.size());
+        _chunk.corners.push_back((long)_count + index);
+    }
+    else
+    {
+        _chunk.corners.push_back(index - 1);
+    }
+    return true;
+}
+
+// Reads a "v", "v/vt", "v//vn" or "v/vt/vn" corner onto _chunk.corners,
+// always as three indices.
+static bool readCorner(const char *&_at, const char *_end, ObjChunk &_chunk)
+{
+    if (!readIndex(_at, _end, _chunk.positions.size() / 3, _chunk))
+        return false;
+
+    if (_at >= _end || *_at != '/')
+    {
+        _chunk.corners.push_back(-1);
+        _chunk.corners.push_back(-1);
+        return true;
+    }
+
+    _at++;
+    if (_at < _end && *_at == '/')
+        _chunk.corners.push_back(-1);
+    else if (!readIndex(_at, _end, _chunk.texcoords.size() / 2, _chunk))
+        return false;
+
+    if (_at >= _end || *_at != '/')
+    {
+        _chunk.corners.push_back(-1);
+        return true;
+    }
+
+    _at++;
+    return readIndex(_at, _end, _chunk.normals.size() / 3, _chunk);
+}
+
+// Reads a face line, after the "f", as a fan of triangles: every corner is
+// read once, then the fan is laid out from them.
+static bool readFace(const char *_at, const char *_end, ObjChunk &_chunk)
+{
+    const size_t first = _chunk.corners.size();
+    int corners_count = 0;
+    while (true)
+    {
+        _at = skipBlanks(_at, _end);
+        if (_at >= _end || *_at == '\r' || *_at == '#')
+            break;
+        if (!readCorner(_at, _end, _chunk))
+            return false;
+        corners_count++;
+    }
+    if (corners_count < 3)
+        return false;
+    if (corners_count == 3)
+        return true;
+
+    // Corner i of the polygon is at first + 3 * i; relative slots past the
+    // first triangle move with their corner.
+    std::vector<int> polygon(_chunk.corners.begin() + first, _chunk.corners.end());
+    std::vector<bool> relative(polygon.size(), false);
+    while (!_chunk.relative_corners.empty() && _chunk.relative_corners.back() >= first)
+    {
+        relative[_chunk.relative_corners.back() - first] = true;
+        _chunk.relative_corners.pop_back();
+    }
+
+    _chunk.corners.resize(first);
+    for (int i = 2; i < corners_count; i++)
+    {
+        for (int corner : {0, i - 1, i})
+        {
+            for (int element = 0; element < 3; element++)
+            {
+                if (relative[(corner * 3) + element])
+                    _chunk.relative_corners.push_back(_chunk.corners.size());
+                _chunk.corners.push_back(polygon[(corner * 3) + element]);
+            }
+        }
+    }
+    return true;
+}
+
+static void parseLines(const char *_at, const char *_end, ObjChunk &_chunk)
+{
+    while (_at < _end)
+    {
+        const char *line_end = (const char *)std::memchr(_at, '\n', _end - _at);
+        if (!line_end)
+            line_end = _end;
+
+        const char *at = skipBlanks(_at, line_end);
+        const size_t length = line_end - at;
+
+        if (length > 2 && at[0] == 'v' && at[1] == ' ')
+        {
+            readFloats(at + 2, line_end, 3, _chunk.positions);
+        }
+        else if (length > 3 && at[0] == 'v' && at[1] == 't' && at[2] == ' ')
+        {
+            readFloats(at + 3, line_end, 2, _chunk.texcoords);
+        }
+        else if (length > 3 && at[0] == 'v' && at[1] == 'n' && at[2] == ' ')
+        {
+            readFloats(at + 3, line_end, 3, _chunk.normals);
+        }
+        else if (length > 2 && at[0] == 'f' && at[1] == ' ')
+        {
+            if (!readFace(at + 2, line_end, _chunk))
+            {
+                _chunk.failed = true;
+                return;
+            }
+        }
+        else if (length >= 6 && std::strncmp(at, "usemtl", 6) == 0)
+        {
+            const char *name_end = line_end;
+            while (name_end > at + 6 && (name_end[-1] == '\r' || name_end[-1] == ' ' || name_end[-1] == '\t'))
+                name_end--;
+            std::string name(skipBlanks(at + 6, name_end), name_end);
+            _chunk.materials.push_back(std::make_pair((int)(_chunk.corners.size() / 9), name));
+        }
+
+        _at = line_end + 1;
+    }
+}
+
+// Appends every chunk's _member to _out, in parallel. Returns where each
+// chunk's part starts, in elements.
+template <typename T>
+static std::vector<size_t> joinChunks(std::vector<ObjChunk> &_chunks, std::vector<T> ObjChunk::*_member, std::vector<T> &_out)
+{
+    std::vector<size_t> offsets(_chunks.size() + 1, 0);
+    for (size_t chunk = 0; chunk < _chunks.size(); chunk++)
+    {
+        offsets[chunk + 1] = offsets[chunk] + (_chunks[chunk].*_member).size();
+    }
+    _out.resize(offsets.back());
+
+    TaskGroup joiners;
+    for (size_t chunk = 0; chunk < _chunks.size(); chunk++)
+    {
+        joiners.run([&, chunk]()
+        {
+            std::vector<T> &part = _chunks[chunk].*_member;
+            std::copy(part.begin(), part.end(), _out.begin() + offsets[chunk]);
+            part.clear();
+            part.shrink_to_fit();
+        });
+    }
+    joiners.wait();
+    return offsets;
+}
+
+// Splits the file into chunks of whole lines and parses them on the pool,
+// then joins them, making every index absolute and checking it.
+static bool readObj(const std::string &_path, ObjData &_data, JobProgress &_progress)
+{
+    MappedFile file;
+    if (!file.open(_path))
+        return false;
+
+    const char *begin = (const char *)file.data();
+    const char *end = begin + file.size();
+    _progress.start(file.size());
+
+    std::vector<const char *> bounds(1, begin);
+    while (bounds.back() < end)
+    {
+        const char *at = bounds.back() + std::min<size_t>(PARSE_CHUNK_BYTES, end - bounds.back());
+        const char *line_end = (at < end) ? (const char *)std::memchr(at, '\n', end - at) : nullptr;
+        bounds.push_back(line_end ? line_end + 1 : end);
+    }
+
+    std::vector<ObjChunk> chunks(bounds.size() - 1);
+    TaskGroup parsers;
+    for (size_t chunk = 0; chunk < chunks.size(); chunk++)
+    {
+        parsers.run([&, chunk]()
+        {
+            if (_progress.isCancelled())
+                return;
+            parseLines(bounds[chunk], bounds[chunk + 1], chunks[chunk]);
+            _progress.advance(bounds[chunk + 1] - bounds[chunk]);
+        });
+    }
+    parsers.wait();
+
+    if (_progress.isCancelled())
+        return false;
+    for (const ObjChunk &chunk : chunks)
+    {
+        if (chunk.failed)
+            return false;
+    }
+
+    // Materials are numbered in order of first use. Faces before the
+    // first usemtl share the first material.
+    std::map<std::string, int> materials;
+    std::vector<int> first_materials(chunks.size());
+    int material = 0;
+    for (size_t chunk = 0; chunk < chunks.size(); chunk++)
+    {
+        first_materials[chunk] = material;
+        for (const std::pair<int, std::string> &use : chunks[chunk].materials)
+        {
+            auto inserted = materials.insert(std::make_pair(use.second, (int)materials.size()));
+            material = inserted.first->second;
+            chunks[chunk].material_ids.push_back(material);
+        }
+    }
+    _data.materials_count = std::max<int>(1, materials.size());
+
+    std::vector<size_t> position_offsets = joinChunks(chunks, &ObjChunk::positions, _data.positions);
+    std::vector<size_t> texcoord_offsets = joinChunks(chunks, &ObjChunk::texcoords, _data.texcoords);
+    std::vector<size_t> normal_offsets = joinChunks(chunks, &ObjChunk::normals, _data.normals);
+
+    std::vector<size_t> corner_offsets(chunks.size() + 1, 0);
+    for (size_t chunk = 0; chunk < chunks.size(); chunk++)
+    {
+        corner_offsets[chunk + 1] = corner_offsets[chunk] + chunks[chunk].corners.size();
+    }
+    _data.corners.resize(corner_offsets.back());
+    _data.face_materials.resize(corner_offsets.back() / 9);
+
+    const int64_t counts[3] = {
+        (int64_t)_data.positions.size() / 3,
+        (int64_t)_data.texcoords.size() / 2,
+        (int64_t)_data.normals.size() / 3};
+
+    std::vector<char> valid(chunks.size(), 1);
+    TaskGroup resolvers;
+    for (size_t chunk = 0; chunk < chunks.size(); chunk++)
+    {
+        resolvers.run([&, chunk]()
+        {
+            ObjChunk &part = chunks[chunk];
+            const int64_t bases[3] = {
+                (int64_t)position_offsets[chunk] / 3,
+                (int64_t)texcoord_offsets[chunk] / 2,
+                (int64_t)normal_offsets[chunk] / 3};
+
+            int *out = _data.corners.data() + corner_offsets[chunk];
+            std::copy(part.corners.begin(), part.corners.end(), out);
+
+            for (size_t slot : part.relative_corners)
+            {
+                const int64_t index = out[slot] + bases[slot % 3];
+                if (index < 0)
+                {
+                    valid[chunk] = 0;
+                    return;
+                }
+                out[slot] = index;
+            }
+
+            // Only positions are required, the rest may be absent (-1).
+            for (size_t slot = 0; slot < part.corners.size(); slot++)
+            {
+                if (out[slot] >= counts[slot % 3] || (slot % 3 == 0 && out[slot] < 0))
+                {
+                    valid[chunk] = 0;
+                    return;
+                }
+            }
+
+            int *face_materials = _data.face_materials.data() + (corner_offsets[chunk] / 9);
+            const int faces_count = part.corners.size() / 9;
+            int material = first_materials[chunk];
+            size_t next_use = 0;
+            for (int face = 0; face < faces_count; face++)
+            {
+                while (next_use < part.materials.size() && part.materials[next_use].first == face)
+                {
+                    material = part.material_ids[next_use];
+                    next_use++;
+                }
+                face_materials[face] = material;
+            }
+
+            part.corners.clear();
+            part.corners.shrink_to_fit();
+        });
+    }
+    resolvers.wait();
+
+    if (std::find(valid.begin(), valid.end(), 0) != valid.end())
+        return false;
+    return !_data.face_materials.empty();
+}
+
+// Copies _faces_count triangles into a new mesh: those listed in _faces,
+// or, without a list, the ones from _first_face on.
+static Mesh buildMesh(const ObjData &_data, const int *_faces, int _first_face, int _faces_count, bool _with_normals)
+{
+    Mesh mesh = {};
+    mesh.triangleCount = _faces_count;
+    mesh.vertexCount = _faces_count * 3;
+    mesh.vertices = (float *)RL_CALLOC(mesh.vertexCount * 3, sizeof(float));
+    mesh.texcoords = (float *)RL_CALLOC(mesh.vertexCount * 2, sizeof(float));
+    if (_with_normals)
+        mesh.normals = (float *)RL_CALLOC(mesh.vertexCount * 3, sizeof(float));
+
+    for (int face = 0; face < _faces_count; face++)
+    {
+        const int source_face = _faces ? _faces[face] : _first_face + face;
+        for (int corner = 0; corner < 3; corner++)
+        {
+            const int *source = _data.corners.data() + ((size_t)source_face * 9) + (corner * 3);
+            const int vertex = (face * 3) + corner;
+
+            std::memcpy(mesh.vertices + (vertex * 3), _data.positions.data() + ((size_t)source[0] * 3), 3 * sizeof(float));
+            if (source[1] >= 0)
+            {
+                mesh.texcoords[(vertex * 2)] = _data.texcoords[((size_t)source[1] * 2)];
+                mesh.texcoords[(vertex * 2) + 1] = 1.0f - _data.texcoords[((size_t)source[1] * 2) + 1];
+            }
+            if (_with_normals && source[2] >= 0)
+                std::memcpy(mesh.normals + (vertex * 3), _data.normals.data() + ((size_t)source[2] * 3), 3 * sizeof(float));
+        }
+    }
+    return mesh;
+}
+
+bool loadObjMeshes(const std::string &_path, std::vector<Mesh> &_meshes, JobProgress &_progress, bool _with_normals)
+{
+    _meshes.clear();
+
+    ObjData data;
+    if (!readObj(_path, data, _progress))
+        return false;
+
+    // Each mesh is a run of faces of one material: a slice of a list of
+    // faces per material, or of the file itself when there is only one.
+    struct MeshFaces
+    {
+        const int *faces;
+        int first_face;
+        int faces_count;
+    };
+    std::vector<MeshFaces> layout;
+    std::vector<std::vector<int>> material_faces;
+
+    if (data.materials_count == 1)
+    {
+        const int faces_count = data.face_materials.size();
+        for (int first = 0; first < faces_count; first += OBJ_MESH_FACES)
+        {
+            layout.push_back({nullptr, first, std::min(OBJ_MESH_FACES, faces_count - first)});
+        }
+    }
+    else
+    {
+        material_faces.resize(data.materials_count);
+        for (int face = 0; face < (int)data.face_materials.size(); face++)
+        {
+            material_faces[data.face_materials[face]].push_back(face);
+        }
+        for (const std::vector<int> &faces : material_faces)
+        {
+            for (int first = 0; first < (int)faces.size(); first += OBJ_MESH_FACES)
+            {
+                layout.push_back({faces.data() + first, 0, std::min<int>(OBJ_MESH_FACES, faces.size() - first)});
+            }
+        }
+    }
+
+    _meshes.resize(layout.size());
+    TaskGroup builders;
+    for (size_t mesh = 0; mesh < layout.size(); mesh++)
+    {
+        builders.run([&, mesh]()
+        {
+            _meshes[mesh] = buildMesh(data, layout[mesh].faces, layout[mesh].first_face, layout[mesh].faces_count, _with_normals);
+        });
+    }
+    builders.wait();
+    return true;
+}
+
+bool loadObjModel(const std::string &_path, Model &_model, JobProgress &_progress)
+{
+    std::vector<Mesh> meshes;
+    if (!loadObjMeshes(_path, meshes, _progress, false))
+        return false;
+
+    _model = Model{};
+    _model.transform = Matrix{1.0f, 0.0f, 0.0f, 0.0f,
+                              0.0f, 1.0f, 0.0f, 0.0f,
+                              0.0f, 0.0f, 1.0f, 0.0f,
+                              0.0f, 0.0f, 0.0f, 1.0f};
+    _model.meshCount = meshes.size();
+    _model.meshes = (Mesh *)RL_CALLOC(meshes.size(), sizeof(Mesh));
+    std::copy(meshes.begin(), meshes.end(), _model.meshes);
+    return true;
+}
+
+void unloadObjMeshes(std::vector<Mesh> &_meshes)
+{
+    for (Mesh &mesh : _meshes)
+    {
+        RL_FREE(mesh.vertices);
+        RL_FREE(mesh.texcoords);
+        RL_FREE(mesh.normals);
+    }
+    _meshes.clear();
+}
+
+void unloadObjModel(Model &_model)
+{
+    std::vector<Mesh> meshes(_model.meshes, _model.meshes + _model.meshCount);
+    unloadObjMeshes(meshes);
+    RL_FREE(_model.meshes);
+    _model = Model{};
+}
@@ -0,0 +1,180 @@
+#include "play_audio.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+SampleRing::SampleRing(size_t _capacity)
+    : samples(_capacity), mask(_capacity - 1), read_index(0), write_index(0)
+{
+}
+
+size_t SampleRing::write(const float *_samples, size_t _count)
+{
+    const size_t write_at = this->write_index.load(std::memory_order_relaxed);
+    const size_t read_at = this->read_index.load(std::memory_order_acquire);
+    const size_t count = std::min(_count, this->samples.size() - (write_at - read_at));
+
+    // The free space may wrap around the end of the storage.
+    const size_t offset = write_at & this->mask;
+    const size_t first = std::min(count, this->samples.size() - offset);
+    std::memcpy(this->samples.data() + offset, _samples, first * sizeof(float));
+    std::memcpy(this->samples.data(), _samples + first, (count - first) * sizeof(float));
+
+    this->write_index.store(write_at + count, std::memory_order_release);
+    return count;
+}
+
+size_t SampleRing::read(float *_samples, size_t _count)
+{
+    const size_t read_at = this->read_index.load(std::memory_order_relaxed);
+    const size_t write_at = this->write_index.load(std::memory_order_acquire);
+    const size_t count = std::min(_count, write_at - read_at);
+
+    const size_t offset = read_at & this->mask;
+    const size_t first = std::min(count, this->samples.size() - offset);
+    std::memcpy(_samples, this->samples.data() + offset, first * sizeof(float));
+    std::memcpy(_samples + first, this->samples.data(), (count - first) * sizeof(float));
+
+    this->read_index.store(read_at + count, std::memory_order_release);
+    return count;
+}
+
+size_t SampleRing::getReadable() const
+{
+    return this->write_index.load(std::memory_order_acquire) - this->read_index.load(std::memory_order_acquire);
+}
+
+size_t SampleRing::getWritable() const
+{
+    return this->samples.size() - getReadable();
+}
+
+void SampleRing::clear()
+{
+    this->read_index.store(0);
+    this->write_index.store(0);
+}
+
+AudioPlayer &AudioPlayer::instance()
+{
+    static AudioPlayer player;
+    return player;
+}
+
+AudioPlayer::AudioPlayer()
+    : ring(PLAYBACK_RING_SAMPLES), stop_requested(false), rendered(false), silent_buffers(0)
+{
+    this->stream = AudioStream{};
+    this->stream_loaded = false;
+    this->channels_count = 1;
+}
+
+// The stream itself has to go before the audio device closes, see stop.
+AudioPlayer::~AudioPlayer()
+{
+    this->stop_requested = true;
+    if (this->worker.joinable())
+        this->worker.join();
+}
+
+void AudioPlayer::play(Renderer _render, int64_t _samples_count, int _sample_rate, int _channels_count)
+{
+    stop();
+
+    this->channels_count = _channels_count;
+    this->stop_requested = false;
+    this->rendered = false;
+    this->silent_buffers = 0;
+    this->worker = std::thread(&AudioPlayer::renderLoop, this, _render, _samples_count);
+
+    // Playback starts at once; the callback plays silence until the first
+    // block arrives.
+    SetAudioStreamBufferSizeDefault(PLAYBACK_DEVICE_FRAMES);
+    this->stream = LoadAudioStream(_sample_rate, 32, _channels_count);
+    this->stream_loaded = true;
+    SetAudioStreamCallback(this->stream, streamCallback);
+    PlayAudioStream(this->stream);
+}
+
+void AudioPlayer::stop()
+{
+    this->stop_requested = true;
+    if (this->worker.joinable())
+        this->worker.join();
+
+    if (this->stream_loaded)
+    {
+        StopAudioStream(this->stream);
+        UnloadAudioStream(this->stream);
+        this->stream_loaded = false;
+    }
+    this->ring.clear();
+}
+
+// The callback fills raylib's buffers ahead of the device, so the last
+// samples are still queued when the ring runs dry. Playback only counts as
+// over once enough whole buffers of silence have followed them.
+bool AudioPlayer::isPlaying()
+{
+    return this->stream_loaded && this->silent_buffers < PLAYBACK_TAIL_BUFFERS;
+}
+
+void AudioPlayer::update()
+{
+    if (this->stream_loaded && !isPlaying())
+        stop();
+}
+
+void AudioPlayer::renderLoop(Renderer _render, int64_t _samples_count)
+{
+    std::vector<float> block(PLAYBACK_BLOCK_SAMPLES);
+
+    for (int64_t block_start = 0; block_start < _samples_count; block_start += PLAYBACK_BLOCK_SAMPLES)
+    {
+        const int64_t block_count = std::min<int64_t>(PLAYBACK_BLOCK_SAMPLES, _samples_count - block_start);
+        _render(block_start, block_count, block.data());
+
+        // Waits for the audio thread to make room, checking for a stop.
+        size_t pushed = 0;
+        while (pushed < (size_t)block_count)
+        {
+            if (this->stop_requested)
+                return;
+
+            size_t count = this->ring.write(block.data() + pushed, block_count - pushed);
+            if (count == 0)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            pushed += count;
+        }
+    }
+
+    this->rendered = true;
+}
+
+// Runs on raylib's audio thread, so it only touches the ring and never
+// blocks or allocates.
+void AudioPlayer::streamCallback(void *_buffer, unsigned int _frames)
+{
+    AudioPlayer &player = instance();
+    float *out = (float *)_buffer;
+    const int channels_count = player.channels_count;
+
+    // Read before the ring, so a short read after it means the end.
+    const bool rendered = player.rendered.load(std::memory_order_acquire);
+    size_t count = player.ring.read(out, _frames);
+    if (rendered && count == 0)
+        player.silent_buffers++;
+
+    // Spread the mono samples over the channels from the back, so none is
+    // overwritten before it is copied, clamping as the WAV export does.
+    for (size_t i = count; i-- > 0;)
+    {
+        const float sample = std::min(std::max(out[i], -1.0f), 1.0f);
+        for (int channel = channels_count - 1; channel >= 0; channel--)
+        {
+            out[(i * channels_count) + channel] = sample;
+        }
+    }
+
+    std::fill(out + (count * channels_count), out + ((size_t)_frames * channels_count), 0.0f);
+}
@@ -0,0 +1,445 @@
+#include "raster_kernel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RASTER_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+// A triangle edge being walked down the buffer: its x position on the
+// current row and how far it moves per row, both in 16.16 fixed point.
+struct RasterEdge
+{
+    int64_t x;
+    int64_t step;
+};
+
+// Sets up the edge from _top to _bottom (_top.y < _bottom.y) positioned on
+// row _y. The position is always derived from the upper end point, so faces
+// sharing this edge agree on it bit for bit.
+static RasterEdge makeEdge(const RasterVertex &_top, const RasterVertex &_bottom, int _y)
+{
+    RasterEdge edge;
+    edge.step = ((int64_t)(_bottom.x - _top.x) << RASTER_FIXED_SHIFT) / (_bottom.y - _top.y);
+    edge.x = ((int64_t)_top.x << RASTER_FIXED_SHIFT) + ((_y - _top.y) * edge.step);
+    return edge;
+}
+
+// First pixel column at or right of a fixed point x position.
+static int ceilFixed(int64_t _x)
+{
+    return (int)((_x + RASTER_FIXED_ONE - 1) >> RASTER_FIXED_SHIFT);
+}
+
+// ==========================================
+// Span writers
+// ==========================================
+
+// Lane values are computed as _z + i * _dz with wrapping 32 bit arithmetic
+// in every writer, clamped to 0-max_fixed and only then converted to the
+// element type, so all of them agree bit for bit.
+
+template <typename T>
+void writeSpanScalar(T *_dst, int _count, int32_t _z, int32_t _dz)
+{
+    uint32_t z = _z;
+    for (int i = 0; i < _count; i++)
+    {
+        _dst[i] = SampleTraits<T>::fromFixed(std::min(std::max((int32_t)z, 0), SampleTraits<T>::max_fixed));
+        z += _dz;
+    }
+}
+
+// Span writer for ramps that leave the int32 range somewhere in the span,
+// which only the steep gradients of slivers and tiny triangles do. Steps
+// in 64 bits and clamps each value, writing what the 32 bit writers would
+// with unlimited range.
+template <typename T>
+static void writeSpanWide(T *_dst, int _count, int64_t _z, int64_t _dz)
+{
+    for (int i = 0; i < _count; i++)
+    {
+        _dst[i] = SampleTraits<T>::fromFixed((int32_t)std::min(std::max(_z, (int64_t)0), (int64_t)SampleTraits<T>::max_fixed));
+        _z += _dz;
+    }
+}
+
+static bool fitsInt32(int64_t _value)
+{
+    return _value >= INT32_MIN && _value <= INT32_MAX;
+}
+
+#ifdef RASTER_X86_DISPATCH
+
+// Stores 8 clamped fixed point lanes, _low holding the first 4.
+__attribute__((target("sse4.1"))) static void storeSse41(uint8_t *_dst, __m128i _low, __m128i _high)
+{
+    const int shift = SampleTraits<uint8_t>::fixed_shift;
+    __m128i words = _mm_packus_epi32(_mm_srli_epi32(_low, shift), _mm_srli_epi32(_high, shift));
+    _mm_storel_epi64((__m128i *)_dst, _mm_packus_epi16(words, words));
+}
+
+__attribute__((target("sse4.1"))) static void storeSse41(uint16_t *_dst, __m128i _low, __m128i _high)
+{
+    const int shift = SampleTraits<uint16_t>::fixed_shift;
+    _mm_storeu_si128((__m128i *)_dst, _mm_packus_epi32(_mm_srli_epi32(_low, shift), _mm_srli_epi32(_high, shift)));
+}
+
+__attribute__((target("sse4.1"))) static void storeSse41(float *_dst, __m128i _low, __m128i _high)
+{
+    const __m128 scale = _mm_set1_ps(SampleTraits<float>::fixed_scale);
+    _mm_storeu_ps(_dst, _mm_mul_ps(_mm_cvtepi32_ps(_low), scale));
+    _mm_storeu_ps(_dst + 4, _mm_mul_ps(_mm_cvtepi32_ps(_high), scale));
+}
+
+template <typename T>
+__attribute__((target("sse4.1"))) static void writeSpanSse41(T *_dst, int _count, int32_t _z, int32_t _dz)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i max_z = _mm_set1_epi32(SampleTraits<T>::max_fixed);
+    const __m128i step = _mm_set1_epi32((int32_t)((uint32_t)_dz * 8));
+
+    __m128i z_low = _mm_add_epi32(_mm_set1_epi32(_z), _mm_mullo_epi32(_mm_setr_epi32(0, 1, 2, 3), _mm_set1_epi32(_dz)));
+    __m128i z_high = _mm_add_epi32(z_low, _mm_set1_epi32((int32_t)((uint32_t)_dz * 4)));
+
+    int i = 0;
+    for (; i + 8 <= _count; i += 8)
+    {
+        __m128i low = _mm_min_epi32(_mm_max_epi32(z_low, zero), max_z);
+        __m128i high = _mm_min_epi32(_mm_max_epi32(z_high, zero), max_z);
+        storeSse41(_dst + i, low, high);
+        z_low = _mm_add_epi32(z_low, step);
+        z_high = _mm_add_epi32(z_high, step);
+    }
+
+    writeSpanScalar(_dst + i, _count - i, (int32_t)((uint32_t)_z + ((uint32_t)_dz * i)), _dz);
+}
+
+// Stores 8 clamped fixed point lanes.
+__attribute__((target("avx2"))) static void storeAvx2(uint8_t *_dst, __m256i _value)
+{
+    __m256i value = _mm256_srli_epi32(_value, SampleTraits<uint8_t>::fixed_shift);
+    __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(value), _mm256_extracti128_si256(value, 1));
+    _mm_storel_epi64((__m128i *)_dst, _mm_packus_epi16(words, words));
+}
+
+__attribute__((target("avx2"))) static void storeAvx2(uint16_t *_dst, __m256i _value)
+{
+    __m256i value = _mm256_srli_epi32(_value, SampleTraits<uint16_t>::fixed_shift);
+    _mm_storeu_si128((__m128i *)_dst, _mm_packus_epi32(_mm256_castsi256_si128(value), _mm256_extracti128_si256(value, 1)));
+}
+
+__attribute__((target("avx2"))) static void storeAvx2(float *_dst, __m256i _value)
+{
+    _mm256_storeu_ps(_dst, _mm256_mul_ps(_mm256_cvtepi32_ps(_value), _mm256_set1_ps(SampleTraits<float>::fixed_scale)));
+}
+
+template <typename T>
+__attribute__((target("avx2"))) static void writeSpanAvx2(T *_dst, int _count, int32_t _z, int32_t _dz)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i max_z = _mm256_set1_epi32(SampleTraits<T>::max_fixed);
+    const __m256i step = _mm256_set1_epi32((int32_t)((uint32_t)_dz * 8));
+
+    __m256i z = _mm256_add_epi32(
+        _mm256_set1_epi32(_z),
+        _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(_dz)));
+
+    int i = 0;
+    for (; i + 8 <= _count; i += 8)
+    {
+        storeAvx2(_dst + i, _mm256_min_epi32(_mm256_max_epi32(z, zero), max_z));
+        z = _mm256_add_epi32(z, step);
+    }
+
+    writeSpanScalar(_dst + i, _count - i, (int32_t)((uint32_t)_z + ((uint32_t)_dz * i)), _dz);
+}
+
+// GCC 12's AVX-512 headers trip -Wmaybe-uninitialized on their own
+// placeholder operands.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+// Stores the lanes of 16 clamped fixed point lanes selected by _mask.
+__attribute__((target("avx512f"))) static void storeAvx512(uint8_t *_dst, __mmask16 _mask, __m512i _value)
+{
+    _mm512_mask_cvtusepi32_storeu_epi8(_dst, _mask, _mm512_srli_epi32(_value, SampleTraits<uint8_t>::fixed_shift));
+}
+
+__attribute__((target("avx512f"))) static void storeAvx512(uint16_t *_dst, __mmask16 _mask, __m512i _value)
+{
+    _mm512_mask_cvtusepi32_storeu_epi16(_dst, _mask, _mm512_srli_epi32(_value, SampleTraits<uint16_t>::fixed_shift));
+}
+
+__attribute__((target("avx512f"))) static void storeAvx512(float *_dst, __mmask16 _mask, __m512i _value)
+{
+    _mm512_mask_storeu_ps(_dst, _mask, _mm512_mul_ps(_mm512_cvtepi32_ps(_value), _mm512_set1_ps(SampleTraits<float>::fixed_scale)));
+}
+
+template <typename T>
+__attribute__((target("avx512f"))) static void writeSpanAvx512(T *_dst, int _count, int32_t _z, int32_t _dz)
+{
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i max_z = _mm512_set1_epi32(SampleTraits<T>::max_fixed);
+    const __m512i step = _mm512_set1_epi32((int32_t)((uint32_t)_dz * 16));
+
+    __m512i z = _mm512_add_epi32(
+        _mm512_set1_epi32(_z),
+        _mm512_mullo_epi32(
+            _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+            _mm512_set1_epi32(_dz)));
+
+    // The tail is handled by a masked store instead of a scalar loop.
+    for (int i = 0; i < _count; i += 16)
+    {
+        __mmask16 mask = (_count - i >= 16) ? 0xFFFF : (__mmask16)((1u << (_count - i)) - 1);
+        storeAvx512(_dst + i, mask, _mm512_min_epi32(_mm512_max_epi32(z, zero), max_z));
+        z = _mm512_add_epi32(z, step);
+    }
+}
+
+#pragma GCC diagnostic pop
+
+#endif
+
+template <typename T>
+using SpanWriter = void (*)(T *, int, int32_t, int32_t);
+
+static bool spanWriterSupported(SpanWriterLevel _level)
+{
+    switch (_level)
+    {
+    case SPAN_WRITER_SCALAR:
+        return true;
+#ifdef RASTER_X86_DISPATCH
+    case SPAN_WRITER_SSE41:
+        return __builtin_cpu_supports("sse4.1");
+    case SPAN_WRITER_AVX2:
+        return __builtin_cpu_supports("avx2");
+    case SPAN_WRITER_AVX512:
+        return __builtin_cpu_supports("avx512f");
+#endif
+    default:
+        return false;
+    }
+}
+
+template <typename T>
+static SpanWriter<T> spanWriterFor(SpanWriterLevel _level)
+{
+    switch (_level)
+    {
+#ifdef RASTER_X86_DISPATCH
+    case SPAN_WRITER_SSE41:
+        return writeSpanSse41<T>;
+    case SPAN_WRITER_AVX2:
+        return writeSpanAvx2<T>;
+    case SPAN_WRITER_AVX512:
+        return writeSpanAvx512<T>;
+#endif
+    default:
+        return writeSpanScalar<T>;
+    }
+}
+
+static SpanWriterLevel selectSpanWriterLevel()
+{
+#ifdef RASTER_X86_DISPATCH
+    __builtin_cpu_init();
+#endif
+
+    const char *requested = getenv("MUSER_SIMD");
+    if (requested)
+    {
+        for (int level = SPAN_WRITER_SCALAR; level <= SPAN_WRITER_AVX512; level++)
+        {
+            if (strcmp(requested, getSpanWriterName((SpanWriterLevel)level)) == 0 &&
+                spanWriterSupported((SpanWriterLevel)level))
+                return (SpanWriterLevel)level;
+        }
+    }
+
+    for (int level = SPAN_WRITER_AVX512; level > SPAN_WRITER_SCALAR; level--)
+    {
+        if (spanWriterSupported((SpanWriterLevel)level))
+            return (SpanWriterLevel)level;
+    }
+    return SPAN_WRITER_SCALAR;
+}
+
+// The selected level and its writer for every element type.
+struct SpanWriters
+{
+    SpanWriterLevel level;
+    SpanWriter<uint8_t> uint8_writer;
+    SpanWriter<uint16_t> uint16_writer;
+    SpanWriter<float> float_writer;
+
+    void select(SpanWriterLevel _level)
+    {
+        this->level = _level;
+        this->uint8_writer = spanWriterFor<uint8_t>(_level);
+        this->uint16_writer = spanWriterFor<uint16_t>(_level);
+        this->float_writer = spanWriterFor<float>(_level);
+    }
+
+    SpanWriter<uint8_t> get(uint8_t *) { return this->uint8_writer; }
+    SpanWriter<uint16_t> get(uint16_t *) { return this->uint16_writer; }
+    SpanWriter<float> get(float *) { return this->float_writer; }
+};
+
+// Built on first use rather than as a namespace-scope global, so the
+// selection never depends on the order statics are initialized in.
+static SpanWriters &spanWriters()
+{
+    static SpanWriters writers = []()
+    {
+        SpanWriters selected;
+        selected.select(selectSpanWriterLevel());
+        return selected;
+    }();
+    return writers;
+}
+
+template <typename T>
+void writeSpan(T *_dst, int _count, int32_t _z, int32_t _dz)
+{
+    spanWriters().get(_dst)(_dst, _count, _z, _dz);
+}
+
+SpanWriterLevel getSpanWriterLevel()
+{
+    return spanWriters().level;
+}
+
+const char *getSpanWriterName(SpanWriterLevel _level)
+{
+    switch (_level)
+    {
+    case SPAN_WRITER_SSE41:
+        return "sse4.1";
+    case SPAN_WRITER_AVX2:
+        return "avx2";
+    case SPAN_WRITER_AVX512:
+        return "avx512";
+    default:
+        return "scalar";
+    }
+}
+
+bool setSpanWriterLevel(SpanWriterLevel _level)
+{
+    if (!spanWriterSupported(_level))
+        return false;
+
+    spanWriters().select(_level);
+    return true;
+}
+
+template <typename T, typename Layout>
+void rasterizeTriangle(
+    const RasterVertex &L,
+    const RasterVertex &M,
+    const RasterVertex &H,
+    const FaceBounds &_clip,
+    T *_buffer,
+    const Layout &_layout)
+{
+    const int z_shift = SampleTraits<T>::fixed_shift;
+
+    // Twice the signed area. Positive when M lies right of the long L-H edge.
+    const int64_t area2 = ((int64_t)(M.x - L.x) * (H.y - L.y)) - ((int64_t)(H.x - L.x) * (M.y - L.y));
+    if (area2 == 0)
+        return;
+
+    // Magnitude plane z = L.z + dzdx * (x - L.x) + dzdy * (y - L.y).
+    const double dzdx = (((double)(M.z - L.z) * (H.y - L.y)) - ((double)(H.z - L.z) * (M.y - L.y))) / area2;
+    const double dzdy = (((double)(M.x - L.x) * (H.z - L.z)) - ((double)(H.x - L.x) * (M.z - L.z))) / area2;
+    // In 64 bits: on slivers and triangles a few pixels across, the
+    // gradient alone can exceed the int32 range of the span writers.
+    const int64_t dzdx_fixed = std::llround(dzdx * (1 << z_shift));
+    const int64_t dzdy_fixed = std::llround(dzdy * (1 << z_shift));
+    const int64_t z_origin = (int64_t)L.z << z_shift;
+
+    const bool long_edge_left = area2 > 0;
+
+    // Upper half uses the L-M edge, lower half the M-H edge; both pair it
+    // with the long L-H edge.
+    const RasterVertex *short_tops[2] = {&L, &M};
+    const RasterVertex *short_bottoms[2] = {&M, &H};
+
+    // Looked up once per triangle rather than per span.
+    const SpanWriter<T> write_span = spanWriters().get(_buffer);
+
+    for (int half = 0; half < 2; half++)
+    {
+        const RasterVertex &short_top = *short_tops[half];
+        const RasterVertex &short_bottom = *short_bottoms[half];
+
+        int y_start = std::max(short_top.y, _clip.y0);
+        int y_end = std::min(short_bottom.y, _clip.y1);
+        if (y_start >= y_end)
+            continue;
+
+        RasterEdge long_edge = makeEdge(L, H, y_start);
+        RasterEdge short_edge = makeEdge(short_top, short_bottom, y_start);
+        RasterEdge &left = long_edge_left ? long_edge : short_edge;
+        RasterEdge &right = long_edge_left ? short_edge : long_edge;
+
+        for (int y = y_start; y < y_end; y++)
+        {
+            int x_start = std::max(ceilFixed(left.x), _clip.x0);
+            int x_end = std::min(ceilFixed(right.x), _clip.x1);
+
+            if (x_start < x_end)
+            {
+                const int count = x_end - x_start;
+                const int64_t z = z_origin +
+                                  (dzdx_fixed * (x_start - L.x)) +
+                                  (dzdy_fixed * (y - L.y));
+                const int64_t z_last = z + (dzdx_fixed * (count - 1));
+
+                // The ramp is linear, so it stays in int32 if both of its
+                // ends do.
+                if (fitsInt32(dzdx_fixed) && fitsInt32(z) && fitsInt32(z_last))
+                    write_span(_buffer + _layout.index(x_start, y), count, (int32_t)z, (int32_t)dzdx_fixed);
+                else
+                    writeSpanWide(_buffer + _layout.index(x_start, y), count, z, dzdx_fixed);
+            }
+
+            left.x += left.step;
+            right.x += right.step;
+        }
+    }
+}
+
+template void writeSpan<uint8_t>(uint8_t *, int, int32_t, int32_t);
+template void writeSpan<uint16_t>(uint16_t *, int, int32_t, int32_t);
+template void writeSpan<float>(float *, int, int32_t, int32_t);
+
+template void writeSpanScalar<uint8_t>(uint8_t *, int, int32_t, int32_t);
+template void writeSpanScalar<uint16_t>(uint16_t *, int, int32_t, int32_t);
+template void writeSpanScalar<float>(float *, int, int32_t, int32_t);
+
+// One instantiation per element type and layout withSampleType and
+// withBufferLayout can pick.
+#define INSTANTIATE_RASTERIZE_TRIANGLE(SAMPLE, LAYOUT)                     \
+    template void rasterizeTriangle<SAMPLE, LAYOUT>(                       \
+        const RasterVertex &, const RasterVertex &, const RasterVertex &, \
+        const FaceBounds &, SAMPLE *, const LAYOUT &);
+
+#define INSTANTIATE_RASTERIZE_TRIANGLE_LAYOUTS(SAMPLE)              \
+    INSTANTIATE_RASTERIZE_TRIANGLE(SAMPLE, DynamicLayout)           \
+    INSTANTIATE_RASTERIZE_TRIANGLE(SAMPLE, PowerOfTwoLayout<8>)     \
+    INSTANTIATE_RASTERIZE_TRIANGLE(SAMPLE, PowerOfTwoLayout<9>)     \
+    INSTANTIATE_RASTERIZE_TRIANGLE(SAMPLE, PowerOfTwoLayout<10>)    \
+    INSTANTIATE_RASTERIZE_TRIANGLE(SAMPLE, PowerOfTwoLayout<11>)    \
+    INSTANTIATE_RASTERIZE_TRIANGLE(SAMPLE, PowerOfTwoLayout<12>)    \
+    INSTANTIATE_RASTERIZE_TRIANGLE(SAMPLE, PowerOfTwoLayout<13>)
+
+INSTANTIATE_RASTERIZE_TRIANGLE_LAYOUTS(uint8_t)
+INSTANTIATE_RASTERIZE_TRIANGLE_LAYOUTS(uint16_t)
+INSTANTIATE_RASTERIZE_TRIANGLE_LAYOUTS(float)
@@ -0,0 +1,214 @@
+#include "raster_scheduler.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <chrono>
+
+// Roughly how many chunks each worker should start out with. More chunks
+// means finer balancing at the cost of more claims per item.
+static const int CHUNKS_PER_THREAD = 16;
+
+static uint64_t packRange(uint32_t _front, uint32_t _back)
+{
+    return (uint64_t(_front) << 32) | _back;
+}
+
+static uint32_t rangeFront(uint64_t _range)
+{
+    return uint32_t(_range >> 32);
+}
+
+static uint32_t rangeBack(uint64_t _range)
+{
+    return uint32_t(_range & 0xFFFFFFFF);
+}
+
+RasterScheduler::RasterScheduler(const std::vector<float> &_item_weights, int _threads_count)
+{
+    this->threads_count = std::max(1, _threads_count);
+    this->queues = std::unique_ptr<WorkerQueue[]>(new WorkerQueue[this->threads_count]);
+    this->thread_stats = std::vector<ThreadStats>(this->threads_count);
+
+    buildChunks(_item_weights);
+    assignChunks();
+}
+
+// Cuts the items into consecutive chunks whose summed weight is close to an
+// even share of the total, so one heavy item does not hide in a chunk full
+// of other work.
+void RasterScheduler::buildChunks(const std::vector<float> &_item_weights)
+{
+    double total_weight = 0.0;
+    for (float weight : _item_weights)
+    {
+        total_weight += weight;
+    }
+
+    const int target_chunks = this->threads_count * CHUNKS_PER_THREAD;
+    const double chunk_weight = total_weight / target_chunks;
+
+    const int items_count = _item_weights.size();
+    int chunk_begin = 0;
+    double current_weight = 0.0;
+
+    for (int item_index = 0; item_index < items_count; item_index++)
+    {
+        current_weight += _item_weights[item_index];
+
+        if (current_weight >= chunk_weight || item_index == items_count - 1)
+        {
+            this->chunks.push_back(Chunk{chunk_begin, item_index + 1, current_weight});
+            chunk_begin = item_index + 1;
+            current_weight = 0.0;
+        }
+    }
+}
+
+// Gives each worker a contiguous run of chunks holding about
+// 1 / threads_count of the total weight.
+void RasterScheduler::assignChunks()
+{
+    double total_weight = 0.0;
+    for (const Chunk &chunk : this->chunks)
+    {
+        total_weight += chunk.weight;
+    }
+
+    const int chunks_count = this->chunks.size();
+    int chunk_index = 0;
+    double assigned_weight = 0.0;
+
+    for (int worker = 0; worker < this->threads_count; worker++)
+    {
+        const int run_begin = chunk_index;
+        const double worker_limit = total_weight * (worker + 1) / this->threads_count;
+
+        if (worker == this->threads_count - 1)
+        {
+            chunk_index = chunks_count;
+        }
+        else
+        {
+            while (chunk_index < chunks_count &&
+                   assigned_weight + (this->chunks[chunk_index].weight / 2) < worker_limit)
+            {
+                assigned_weight += this->chunks[chunk_index].weight;
+                chunk_index++;
+            }
+        }
+
+        this->queues[worker].range.store(packRange(run_begin, chunk_index));
+    }
+}
+
+bool RasterScheduler::popFront(int _worker, int &_chunk_index)
+{
+    std::atomic<uint64_t> &range = this->queues[_worker].range;
+    uint64_t current = range.load();
+
+    while (rangeFront(current) < rangeBack(current))
+    {
+        uint64_t next = packRange(rangeFront(current) + 1, rangeBack(current));
+        if (range.compare_exchange_weak(current, next))
+        {
+            _chunk_index = rangeFront(current);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool RasterScheduler::stealBack(int _victim, int &_chunk_index)
+{
+    std::atomic<uint64_t> &range = this->queues[_victim].range;
+    uint64_t current = range.load();
+
+    while (rangeFront(current) < rangeBack(current))
+    {
+        uint64_t next = packRange(rangeFront(current), rangeBack(current) - 1);
+        if (range.compare_exchange_weak(current, next))
+        {
+            _chunk_index = rangeBack(current) - 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+void RasterScheduler::workerLoop(int _worker, std::function<void(int, int)> &_work)
+{
+    using clock = std::chrono::steady_clock;
+    ThreadStats &stats = this->thread_stats[_worker];
+
+    auto run_chunk = [&](int _chunk_index)
+    {
+        const Chunk &chunk = this->chunks[_chunk_index];
+        auto start = clock::now();
+        _work(chunk.begin, chunk.end);
+        stats.busy_ms += std::chrono::duration<double, std::milli>(clock::now() - start).count();
+        stats.items += chunk.end - chunk.begin;
+        stats.chunks++;
+    };
+
+    int chunk_index;
+    while (popFront(_worker, chunk_index))
+    {
+        run_chunk(chunk_index);
+    }
+
+    // Own run exhausted, steal from the others starting with the neighbour
+    // so thieves spread out instead of all hammering worker 0.
+    for (int offset = 1; offset < this->threads_count; offset++)
+    {
+        int victim = (_worker + offset) % this->threads_count;
+        while (stealBack(victim, chunk_index))
+        {
+            run_chunk(chunk_index);
+            stats.stolen_chunks++;
+        }
+    }
+}
+
+void RasterScheduler::run(std::function<void(int, int)> _work)
+{
+    using clock = std::chrono::steady_clock;
+    std::vector<clock::time_point> finish_times(this->threads_count);
+    TaskGroup workers;
+
+    auto run_start = clock::now();
+
+    for (int worker = 0; worker < this->threads_count; worker++)
+    {
+        workers.run([this, worker, &_work, &finish_times]()
+        {
+            workerLoop(worker, _work);
+            finish_times[worker] = clock::now();
+        });
+    }
+
+    workers.wait();
+
+    auto run_end = *std::max_element(finish_times.begin(), finish_times.end());
+    double run_ms = std::chrono::duration<double, std::milli>(run_end - run_start).count();
+
+    // Everything a worker did not spend inside _work is idle: claiming and
+    // stealing chunks, and waiting for the slowest worker to finish.
+    for (ThreadStats &stats : this->thread_stats)
+    {
+        stats.idle_ms = std::max(0.0, run_ms - stats.busy_ms);
+    }
+}
+
+int RasterScheduler::getThreadsCount()
+{
+    return this->threads_count;
+}
+
+int RasterScheduler::getChunksCount()
+{
+    return this->chunks.size();
+}
+
+std::vector<ThreadStats> RasterScheduler::getThreadStats()
+{
+    return this->thread_stats;
+}
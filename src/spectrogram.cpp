@@ -0,0 +1,71 @@
+#include "spectrogram.h"
+#include <algorithm>
+
+Spectrogram::Spectrogram() : Spectrogram(0, 0, SPECTROGRAM_UINT8)
+{
+}
+
+Spectrogram::Spectrogram(int _width, int _height, SpectrogramFormat _format)
+{
+    this->width = _width;
+    this->height = _height;
+    this->format = _format;
+    this->storage = std::vector<uint8_t>(getByteSize(), 0);
+}
+
+int Spectrogram::getWidth() const
+{
+    return this->width;
+}
+
+int Spectrogram::getHeight() const
+{
+    return this->height;
+}
+
+SpectrogramFormat Spectrogram::getFormat() const
+{
+    return this->format;
+}
+
+size_t Spectrogram::getElementSize() const
+{
+    switch (this->format)
+    {
+    case SPECTROGRAM_UINT16:
+        return sizeof(uint16_t);
+    case SPECTROGRAM_FLOAT:
+        return sizeof(float);
+    default:
+        return sizeof(uint8_t);
+    }
+}
+
+size_t Spectrogram::getByteSize() const
+{
+    return (size_t)this->width * this->height * getElementSize();
+}
+
+const uint8_t *Spectrogram::bytes() const
+{
+    return this->storage.data();
+}
+
+double Spectrogram::getNormalized(int _x, int _y) const
+{
+    size_t index = ((size_t)_y * this->width) + _x;
+    double value = 0.0;
+
+    withSampleType(this->format, [&](auto _sample)
+    {
+        using T = decltype(_sample);
+        value = data<T>()[index] / SampleTraits<T>::max_value;
+    });
+
+    return value;
+}
+
+void Spectrogram::clear()
+{
+    std::fill(this->storage.begin(), this->storage.end(), 0);
+}
@@ -0,0 +1,529 @@
+#include "synth_engine.h"
+#include "raster_kernel.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SYNTH_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+static const double TWO_PI = 6.283185307179586;
+
+// Reference loop. Per lane and sample: add amplitude * sin, then rotate
+// (cos, sin) by the row's step.
+static void renderOscillatorsScalar(
+    const float *_amplitudes,
+    const float *_step_cos,
+    const float *_step_sin,
+    float *_cos,
+    float *_sin,
+    int _rows,
+    int _count,
+    float *_lanes)
+{
+    for (int group = 0; group < _rows; group += SYNTH_LANES)
+    {
+        for (int i = 0; i < _count; i++)
+        {
+            float *lanes = _lanes + (i * SYNTH_LANES);
+            for (int lane = 0; lane < SYNTH_LANES; lane++)
+            {
+                int row = group + lane;
+                float c = _cos[row];
+                float s = _sin[row];
+
+                lanes[lane] = lanes[lane] + (_amplitudes[row] * s);
+                _cos[row] = (c * _step_cos[row]) - (s * _step_sin[row]);
+                _sin[row] = (c * _step_sin[row]) + (s * _step_cos[row]);
+            }
+        }
+    }
+}
+
+#ifdef SYNTH_X86_DISPATCH
+
+__attribute__((target("avx2"))) static void renderOscillatorsAvx2(
+    const float *_amplitudes,
+    const float *_step_cos,
+    const float *_step_sin,
+    float *_cos,
+    float *_sin,
+    int _rows,
+    int _count,
+    float *_lanes)
+{
+    for (int group = 0; group < _rows; group += SYNTH_LANES)
+    {
+        const __m256 amplitude = _mm256_loadu_ps(_amplitudes + group);
+        const __m256 step_cos = _mm256_loadu_ps(_step_cos + group);
+        const __m256 step_sin = _mm256_loadu_ps(_step_sin + group);
+        __m256 c = _mm256_loadu_ps(_cos + group);
+        __m256 s = _mm256_loadu_ps(_sin + group);
+
+        for (int i = 0; i < _count; i++)
+        {
+            float *lanes = _lanes + (i * SYNTH_LANES);
+            _mm256_storeu_ps(lanes, _mm256_add_ps(_mm256_loadu_ps(lanes), _mm256_mul_ps(amplitude, s)));
+
+            __m256 next_c = _mm256_sub_ps(_mm256_mul_ps(c, step_cos), _mm256_mul_ps(s, step_sin));
+            s = _mm256_add_ps(_mm256_mul_ps(c, step_sin), _mm256_mul_ps(s, step_cos));
+            c = next_c;
+        }
+
+        _mm256_storeu_ps(_cos + group, c);
+        _mm256_storeu_ps(_sin + group, s);
+    }
+}
+
+#endif
+
+void renderOscillators(
+    const float *_amplitudes,
+    const float *_step_cos,
+    const float *_step_sin,
+    float *_cos,
+    float *_sin,
+    int _rows,
+    int _count,
+    float *_lanes)
+{
+#ifdef SYNTH_X86_DISPATCH
+    if (getSpanWriterLevel() >= SPAN_WRITER_AVX2)
+    {
+        renderOscillatorsAvx2(_amplitudes, _step_cos, _step_sin, _cos, _sin, _rows, _count, _lanes);
+        return;
+    }
+#endif
+    renderOscillatorsScalar(_amplitudes, _step_cos, _step_sin, _cos, _sin, _rows, _count, _lanes);
+}
+
+// Phasor of an oscillator turning _frequency radians per sample, at sample
+// _sample, computed in double precision from scratch rather than carried
+// over.
+static void exactPhase(double _frequency, int64_t _sample, float &_cos, float &_sin)
+{
+    double phase = std::fmod(_frequency * (double)_sample, TWO_PI);
+    _cos = std::cos(phase);
+    _sin = std::sin(phase);
+}
+
+SynthEngine::SynthEngine(const std::vector<double> &_frequencies, const ActiveRows &_active_rows, int64_t _samples_count)
+{
+    this->active_rows = &_active_rows;
+    this->rows_count = _frequencies.size();
+    this->columns_count = _active_rows.getColumnsCount();
+    this->samples_count = _samples_count;
+
+    this->frequencies = std::vector<double>(this->rows_count);
+    this->step_cos = std::vector<float>(this->rows_count);
+    this->step_sin = std::vector<float>(this->rows_count);
+
+    for (int row = 0; row < this->rows_count; row++)
+    {
+        double frequency = std::fmod(_frequencies[row], TWO_PI);
+        this->frequencies[row] = frequency;
+        this->step_cos[row] = std::cos(frequency);
+        this->step_sin[row] = std::sin(frequency);
+    }
+
+    this->amplitudes = std::vector<float>(_active_rows.getEntriesCount(), 0.0f);
+}
+
+int SynthEngine::getRowsCount() const
+{
+    return this->rows_count;
+}
+
+int SynthEngine::getColumnsCount() const
+{
+    return this->columns_count;
+}
+
+int64_t SynthEngine::getSamplesCount() const
+{
+    return this->samples_count;
+}
+
+float *SynthEngine::getAmplitudes(int _column)
+{
+    return this->amplitudes.data() + this->active_rows->columnOffset(_column);
+}
+
+int SynthEngine::columnOf(int64_t _sample) const
+{
+    return (_sample * this->columns_count) / this->samples_count;
+}
+
+int64_t SynthEngine::firstSampleOf(int _column) const
+{
+    return (((int64_t)_column * this->samples_count) + this->columns_count - 1) / this->columns_count;
+}
+
+void SynthEngine::render(float *_out) const
+{
+    render(0, this->samples_count, _out);
+}
+
+void SynthEngine::render(int64_t _begin, int64_t _count, float *_out) const
+{
+    const int64_t end = _begin + _count;
+
+    TaskGroup synthesizers;
+    int64_t block_start = _begin;
+    while (block_start < end)
+    {
+        const int64_t block_end = std::min(end, ((block_start / SYNTH_BLOCK_SAMPLES) + 1) * SYNTH_BLOCK_SAMPLES);
+        synthesizers.run([this, block_start, block_end, _begin, _out]()
+        {
+            renderBlock(block_start, block_end - block_start, _out + (block_start - _begin));
+        });
+        block_start = block_end;
+    }
+    synthesizers.wait();
+}
+
+// Working arrays of renderBlock. Every thread keeps its own and only ever
+// grows them, so once a worker has rendered a block of the widest engine
+// rendering allocates nothing.
+struct SynthScratch
+{
+    // Phasor of every row, and the sample it is valid at.
+    std::vector<float> row_cos;
+    std::vector<float> row_sin;
+    std::vector<int64_t> row_sample;
+
+    // The active rows of the current run, packed into lanes.
+    std::vector<float> run_amplitudes;
+    std::vector<float> run_step_cos;
+    std::vector<float> run_step_sin;
+    std::vector<float> run_cos;
+    std::vector<float> run_sin;
+
+    std::vector<float> lanes;
+
+    void reserve(int _rows_count, int _padded_rows_count)
+    {
+        if ((int)this->row_cos.size() < _rows_count)
+        {
+            this->row_cos.resize(_rows_count);
+            this->row_sin.resize(_rows_count);
+            this->row_sample.resize(_rows_count);
+        }
+        if ((int)this->run_amplitudes.size() < _padded_rows_count)
+        {
+            this->run_amplitudes.resize(_padded_rows_count);
+            this->run_step_cos.resize(_padded_rows_count);
+            this->run_step_sin.resize(_padded_rows_count);
+            this->run_cos.resize(_padded_rows_count);
+            this->run_sin.resize(_padded_rows_count);
+        }
+        this->lanes.resize((size_t)SYNTH_BLOCK_SAMPLES * SYNTH_LANES);
+    }
+};
+
+static thread_local SynthScratch synth_scratch;
+
+void SynthEngine::renderBlock(int64_t _begin, int _count, float *_out) const
+{
+    const int padded_rows_count = ((this->rows_count + SYNTH_LANES - 1) / SYNTH_LANES) * SYNTH_LANES;
+
+    SynthScratch &scratch = synth_scratch;
+    scratch.reserve(this->rows_count, padded_rows_count);
+
+    float *row_cos = scratch.row_cos.data();
+    float *row_sin = scratch.row_sin.data();
+    int64_t *row_sample = scratch.row_sample.data();
+    float *run_amplitudes = scratch.run_amplitudes.data();
+    float *run_step_cos = scratch.run_step_cos.data();
+    float *run_step_sin = scratch.run_step_sin.data();
+    float *run_cos = scratch.run_cos.data();
+    float *run_sin = scratch.run_sin.data();
+    float *lanes = scratch.lanes.data();
+
+    const int64_t end = _begin + _count;
+    int64_t block_begin = _begin;
+
+    while (block_begin < end)
+    {
+        const int64_t block_end = std::min(end, ((block_begin / SYNTH_BLOCK_SAMPLES) + 1) * SYNTH_BLOCK_SAMPLES);
+        const int block_count = block_end - block_begin;
+
+        // No phasor carries over into a new block.
+        std::fill(row_sample, row_sample + this->rows_count, -1);
+        std::fill(lanes, lanes + (block_count * SYNTH_LANES), 0.0f);
+
+        // Within a block, runs of samples sharing a column share amplitudes.
+        int64_t run_begin = block_begin;
+        while (run_begin < block_end)
+        {
+            const int column = columnOf(run_begin);
+            const int64_t run_end = std::min(block_end, firstSampleOf(column + 1));
+
+            const int *rows = this->active_rows->columnRowsBegin(column);
+            const float *amplitudes = this->amplitudes.data() + this->active_rows->columnOffset(column);
+            const int active_count = this->active_rows->columnRowsCount(column);
+            const int lanes_count = ((active_count + SYNTH_LANES - 1) / SYNTH_LANES) * SYNTH_LANES;
+
+            for (int i = 0; i < active_count; i++)
+            {
+                const int row = rows[i];
+                if (row_sample[row] != run_begin)
+                    exactPhase(this->frequencies[row], run_begin, row_cos[row], row_sin[row]);
+
+                run_amplitudes[i] = amplitudes[i];
+                run_step_cos[i] = this->step_cos[row];
+                run_step_sin[i] = this->step_sin[row];
+                run_cos[i] = row_cos[row];
+                run_sin[i] = row_sin[row];
+            }
+
+            // Padding lanes have no amplitude and never turn.
+            for (int i = active_count; i < lanes_count; i++)
+            {
+                run_amplitudes[i] = 0.0f;
+                run_step_cos[i] = 1.0f;
+                run_step_sin[i] = 0.0f;
+                run_cos[i] = 1.0f;
+                run_sin[i] = 0.0f;
+            }
+
+            renderOscillators(
+                run_amplitudes,
+                run_step_cos,
+                run_step_sin,
+                run_cos,
+                run_sin,
+                lanes_count,
+                run_end - run_begin,
+                lanes + ((run_begin - block_begin) * SYNTH_LANES));
+
+            for (int i = 0; i < active_count; i++)
+            {
+                row_cos[rows[i]] = run_cos[i];
+                row_sin[rows[i]] = run_sin[i];
+                row_sample[rows[i]] = run_end;
+            }
+
+            run_begin = run_end;
+        }
+
+        for (int i = 0; i < block_count; i++)
+        {
+            const float *sample_lanes = lanes + (i * SYNTH_LANES);
+            float sample = 0.0f;
+            for (int lane = 0; lane < SYNTH_LANES; lane++)
+            {
+                sample += sample_lanes[lane];
+            }
+            _out[(block_begin - _begin) + i] = sample;
+        }
+
+        block_begin = block_end;
+    }
+}
+
+// Frames are transformed this many at a time before being added up.
+static const int FRAMES_PER_BATCH = 32;
+
+// Transformed frames are added into the output in blocks of this many
+// samples, one pool task per block.
+static const int64_t OVERLAP_ADD_BLOCK_SAMPLES = 4096;
+
+OverlapAddEngine::OverlapAddEngine(const std::vector<int> &_bins, int _fft_size, const ActiveRows &_active_rows, int64_t _samples_count)
+    : fft(_fft_size)
+{
+    this->active_rows = &_active_rows;
+    this->rows_count = _bins.size();
+    this->columns_count = _active_rows.getColumnsCount();
+    this->samples_count = _samples_count;
+    this->fft_size = _fft_size;
+    // Bins past the Nyquist bin have no place in a real spectrum.
+    this->bins = _bins;
+    for (int &bin : this->bins)
+    {
+        bin = std::min(std::max(bin, 0), _fft_size / 2);
+    }
+
+    this->window = std::vector<float>(_fft_size);
+    this->phase_cos = std::vector<float>(_fft_size);
+    this->phase_sin = std::vector<float>(_fft_size);
+    for (int i = 0; i < _fft_size; i++)
+    {
+        double angle = (TWO_PI * i) / _fft_size;
+        this->window[i] = 0.5 - (0.5 * std::cos(angle));
+        this->phase_cos[i] = std::cos(angle);
+        this->phase_sin[i] = std::sin(angle);
+    }
+
+    this->amplitudes = std::vector<float>(_active_rows.getEntriesCount(), 0.0f);
+}
+
+int OverlapAddEngine::getRowsCount() const
+{
+    return this->rows_count;
+}
+
+int OverlapAddEngine::getColumnsCount() const
+{
+    return this->columns_count;
+}
+
+int64_t OverlapAddEngine::getSamplesCount() const
+{
+    return this->samples_count;
+}
+
+int OverlapAddEngine::getFftSize() const
+{
+    return this->fft_size;
+}
+
+float *OverlapAddEngine::getAmplitudes(int _column)
+{
+    return this->amplitudes.data() + this->active_rows->columnOffset(_column);
+}
+
+int64_t OverlapAddEngine::firstSampleOf(int _column) const
+{
+    return (((int64_t)_column * this->samples_count) + this->columns_count - 1) / this->columns_count;
+}
+
+// Frames are centered on the middle of their column.
+int64_t OverlapAddEngine::frameStart(int _column) const
+{
+    return ((firstSampleOf(_column) + firstSampleOf(_column + 1)) / 2) - (this->fft_size / 2);
+}
+
+// Writes the windowed frame of _column to _frame. _real and _imag are
+// scratch space of fft_size / 2 + 1 values.
+void OverlapAddEngine::synthesizeFrame(int _column, float *_real, float *_imag, float *_frame) const
+{
+    const int half_size = this->fft_size / 2;
+    const int64_t start = frameStart(_column);
+    const int *rows = this->active_rows->columnRowsBegin(_column);
+    const float *amplitudes = this->amplitudes.data() + this->active_rows->columnOffset(_column);
+    const int active_count = this->active_rows->columnRowsCount(_column);
+
+    std::fill(_real, _real + half_size + 1, 0.0f);
+    std::fill(_imag, _imag + half_size + 1, 0.0f);
+
+    // Bin k carries A * sin(2 pi k n / N) for the absolute sample n = start + j,
+    // i.e. A / 2 * e^(i (2 pi k start / N - pi / 2)) before the transform.
+    for (int i = 0; i < active_count; i++)
+    {
+        const int bin = this->bins[rows[i]];
+
+        int64_t turn = ((int64_t)bin * start) % this->fft_size;
+        int q = (turn < 0) ? turn + this->fft_size : turn;
+        float half_amplitude = 0.5f * amplitudes[i];
+
+        _real[bin] += half_amplitude * this->phase_sin[q];
+        _imag[bin] -= half_amplitude * this->phase_cos[q];
+    }
+
+    this->fft.inverse(_real, _imag, _frame);
+
+    for (int j = 0; j < this->fft_size; j++)
+    {
+        _frame[j] *= this->window[j];
+    }
+}
+
+// First column whose frame reaches past _sample. Frame starts only grow
+// with the column, so this is a binary search.
+int OverlapAddEngine::firstFrameEndingAfter(int64_t _sample) const
+{
+    int low = 0;
+    int high = this->columns_count;
+    while (low < high)
+    {
+        int middle = low + ((high - low) / 2);
+        if (frameStart(middle) + this->fft_size > _sample)
+            high = middle;
+        else
+            low = middle + 1;
+    }
+    return low;
+}
+
+void OverlapAddEngine::render(float *_out) const
+{
+    render(0, this->samples_count, _out);
+}
+
+void OverlapAddEngine::render(int64_t _begin, int64_t _count, float *_out) const
+{
+    const int half_size = this->fft_size / 2;
+    const int64_t end = _begin + _count;
+
+    std::vector<float> window_sum(_count, 0.0f);
+    std::fill(_out, _out + _count, 0.0f);
+
+    // The columns whose frames overlap the range.
+    const int first_column = firstFrameEndingAfter(_begin);
+    int last_column = first_column;
+    while (last_column < this->columns_count && frameStart(last_column) < end)
+    {
+        last_column++;
+    }
+
+    std::vector<std::vector<float>> frames(FRAMES_PER_BATCH, std::vector<float>(this->fft_size));
+
+    for (int batch_start = first_column; batch_start < last_column; batch_start += FRAMES_PER_BATCH)
+    {
+        const int batch_end = std::min(last_column, batch_start + FRAMES_PER_BATCH);
+
+        TaskGroup transforms;
+        for (int column = batch_start; column < batch_end; column++)
+        {
+            transforms.run([this, column, batch_start, half_size, &frames]()
+            {
+                std::vector<float> real(half_size + 1);
+                std::vector<float> imag(half_size + 1);
+                synthesizeFrame(column, real.data(), imag.data(), frames[column - batch_start].data());
+            });
+        }
+        transforms.wait();
+
+        // The batch is added in parallel over fixed blocks of output
+        // samples. Each block adds the frames in column order, so every
+        // sample is summed in the same order as a serial pass would.
+        const int64_t batch_begin_sample = std::max<int64_t>(_begin, frameStart(batch_start));
+        const int64_t batch_end_sample = std::min<int64_t>(end, frameStart(batch_end - 1) + this->fft_size);
+
+        TaskGroup adders;
+        for (int64_t block = batch_begin_sample / OVERLAP_ADD_BLOCK_SAMPLES;
+             block * OVERLAP_ADD_BLOCK_SAMPLES < batch_end_sample;
+             block++)
+        {
+            adders.run([this, block, batch_start, batch_end, batch_begin_sample, batch_end_sample, _begin, &frames, &window_sum, _out]()
+            {
+                const int64_t block_begin = std::max(batch_begin_sample, block * OVERLAP_ADD_BLOCK_SAMPLES);
+                const int64_t block_end = std::min(batch_end_sample, (block + 1) * OVERLAP_ADD_BLOCK_SAMPLES);
+
+                for (int column = batch_start; column < batch_end; column++)
+                {
+                    const float *frame = frames[column - batch_start].data();
+                    const int64_t start = frameStart(column);
+                    const int64_t begin = std::max(block_begin, start);
+                    const int64_t end = std::min(block_end, start + this->fft_size);
+
+                    for (int64_t n = begin; n < end; n++)
+                    {
+                        _out[n - _begin] += frame[n - start];
+                        window_sum[n - _begin] += this->window[n - start];
+                    }
+                }
+            });
+        }
+        adders.wait();
+    }
+
+    for (int64_t i = 0; i < _count; i++)
+    {
+        if (window_sum[i] > 1e-3f)
+            _out[i] /= window_sum[i];
+    }
+}
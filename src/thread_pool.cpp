@@ -0,0 +1,219 @@
+#include "thread_pool.h"
+#include <algorithm>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+static int configured_threads_count = 0;
+static bool configured_pin_threads = false;
+static bool pool_created = false;
+
+ThreadPool::ThreadPool(int _threads_count, bool _pin_threads)
+{
+    pool_created = true;
+    start(_threads_count, _pin_threads);
+}
+
+ThreadPool::~ThreadPool()
+{
+    stop();
+}
+
+ThreadPool &ThreadPool::instance()
+{
+    static ThreadPool pool(configured_threads_count, configured_pin_threads);
+    return pool;
+}
+
+void ThreadPool::configure(int _threads_count, bool _pin_threads)
+{
+    configured_threads_count = _threads_count;
+    configured_pin_threads = _pin_threads;
+
+    if (pool_created)
+    {
+        ThreadPool &pool = instance();
+        pool.stop();
+        pool.start(_threads_count, _pin_threads);
+    }
+}
+
+int ThreadPool::getThreadsCount()
+{
+    return this->workers.size();
+}
+
+void ThreadPool::start(int _threads_count, bool _pin_threads)
+{
+    if (_threads_count <= 0)
+    {
+        _threads_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    this->stopping = false;
+
+    for (int worker = 0; worker < _threads_count; worker++)
+    {
+        this->workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+
+        if (_pin_threads)
+        {
+            pinThread(this->workers.back(), worker);
+        }
+    }
+}
+
+void ThreadPool::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->queue_mutex);
+        this->stopping = true;
+    }
+    this->queue_condition.notify_all();
+
+    for (std::thread &worker : this->workers)
+    {
+        worker.join();
+    }
+    this->workers.clear();
+}
+
+// Pins a worker to a single CPU out of the ones this process may run on.
+void ThreadPool::pinThread(std::thread &_thread, int _worker)
+{
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0)
+        return;
+
+    int target = _worker % CPU_COUNT(&allowed);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (!CPU_ISSET(cpu, &allowed))
+            continue;
+
+        if (target-- == 0)
+        {
+            cpu_set_t pinned;
+            CPU_ZERO(&pinned);
+            CPU_SET(cpu, &pinned);
+            pthread_setaffinity_np(_thread.native_handle(), sizeof(pinned), &pinned);
+            return;
+        }
+    }
+#else
+    (void)_thread;
+    (void)_worker;
+#endif
+}
+
+void ThreadPool::workerLoop()
+{
+    while (true)
+    {
+        std::function<void()> task;
+        TaskGroup *group;
+
+        {
+            std::unique_lock<std::mutex> lock(this->queue_mutex);
+            this->queue_condition.wait(lock, [this]()
+                                       { return this->stopping || !this->ready_groups.empty(); });
+
+            if (this->ready_groups.empty())
+                return;
+
+            // Take one task from the group at the front, then send the group
+            // to the back of the line if it still has work queued.
+            group = this->ready_groups.front();
+            this->ready_groups.pop_front();
+
+            task = std::move(group->tasks.front());
+            group->tasks.pop_front();
+
+            if (group->tasks.empty())
+                group->scheduled = false;
+            else
+                this->ready_groups.push_back(group);
+        }
+
+        task();
+
+        std::lock_guard<std::mutex> lock(this->queue_mutex);
+        if (--group->pending == 0)
+            group->done_condition.notify_all();
+    }
+}
+
+// Queues _group for the workers. Expects queue_mutex to be held.
+void ThreadPool::schedule(TaskGroup *_group)
+{
+    if (!_group->scheduled)
+    {
+        _group->scheduled = true;
+        this->ready_groups.push_back(_group);
+    }
+    this->queue_condition.notify_one();
+}
+
+// Runs one of _group's queued tasks on the calling thread. Returns false if
+// the group has nothing left in its queue.
+bool ThreadPool::runNextTask(TaskGroup *_group)
+{
+    std::function<void()> task;
+
+    {
+        std::lock_guard<std::mutex> lock(this->queue_mutex);
+        if (_group->tasks.empty())
+            return false;
+
+        task = std::move(_group->tasks.front());
+        _group->tasks.pop_front();
+
+        if (_group->tasks.empty() && _group->scheduled)
+        {
+            _group->scheduled = false;
+            this->ready_groups.erase(
+                std::find(this->ready_groups.begin(), this->ready_groups.end(), _group));
+        }
+    }
+
+    task();
+
+    std::lock_guard<std::mutex> lock(this->queue_mutex);
+    if (--_group->pending == 0)
+        _group->done_condition.notify_all();
+    return true;
+}
+
+TaskGroup::TaskGroup(ThreadPool &_pool) : pool(_pool)
+{
+    this->pending = 0;
+    this->scheduled = false;
+}
+
+TaskGroup::~TaskGroup()
+{
+    wait();
+}
+
+void TaskGroup::run(std::function<void()> _task)
+{
+    std::lock_guard<std::mutex> lock(this->pool.queue_mutex);
+    this->tasks.push_back(std::move(_task));
+    this->pending++;
+    this->pool.schedule(this);
+}
+
+void TaskGroup::wait()
+{
+    while (this->pool.runNextTask(this))
+    {
+    }
+
+    std::unique_lock<std::mutex> lock(this->pool.queue_mutex);
+    this->done_condition.wait(lock, [this]()
+                              { return this->pending == 0; });
+}
@@ -0,0 +1,162 @@
+#include "tile_bins.h"
+#include "thread_pool.h"
+#include <algorithm>
+
+// Faces are binned in contiguous blocks, one pool task per block. Every
+// block keeps a count per tile, so there are at most a few blocks per
+// worker, each of at least a minimum size.
+static const int MIN_FACES_PER_BIN_BLOCK = 8192;
+static const int BIN_BLOCKS_PER_THREAD = 2;
+
+TileBins::TileBins(int _width, int _height, int _tile_size)
+{
+    this->width = _width;
+    this->height = _height;
+    this->tile_size = _tile_size;
+    this->tiles_x = (_width + _tile_size - 1) / _tile_size;
+    this->tiles_y = (_height + _tile_size - 1) / _tile_size;
+    this->tile_offsets = std::vector<int>(getTilesCount() + 1, 0);
+    this->tile_weights = std::vector<float>(getTilesCount(), 0.0f);
+}
+
+// Converts a face's pixel box into the (half-open) range of tiles it
+// touches. Returns false for faces that touch no tile.
+bool TileBins::tileRange(const FaceBounds &_bounds, FaceBounds &_tiles)
+{
+    int x0 = std::max(_bounds.x0, 0);
+    int y0 = std::max(_bounds.y0, 0);
+    int x1 = std::min(_bounds.x1, this->width);
+    int y1 = std::min(_bounds.y1, this->height);
+
+    if (x0 >= x1 || y0 >= y1)
+        return false;
+
+    _tiles.x0 = x0 / this->tile_size;
+    _tiles.y0 = y0 / this->tile_size;
+    _tiles.x1 = ((x1 - 1) / this->tile_size) + 1;
+    _tiles.y1 = ((y1 - 1) / this->tile_size) + 1;
+    return true;
+}
+
+void TileBins::build(const std::vector<FaceBounds> &_bounds)
+{
+    const int faces_count = _bounds.size();
+    const int tiles_count = getTilesCount();
+    const int max_blocks = std::max(1, ThreadPool::instance().getThreadsCount() * BIN_BLOCKS_PER_THREAD);
+    const int blocks_count = std::min(max_blocks, std::max(1, (faces_count + MIN_FACES_PER_BIN_BLOCK - 1) / MIN_FACES_PER_BIN_BLOCK));
+    const int faces_per_block = std::max(1, (faces_count + blocks_count - 1) / blocks_count);
+
+    // First pass: every block counts how many of its faces land in each
+    // tile, and how much area they cover there. Block b's row of each
+    // table starts at b * tiles_count.
+    std::vector<int> block_offsets((size_t)blocks_count * tiles_count, 0);
+    std::vector<float> block_weights((size_t)blocks_count * tiles_count, 0.0f);
+
+    TaskGroup counters;
+    for (int block = 0; block < blocks_count; block++)
+    {
+        counters.run([this, block, faces_count, faces_per_block, tiles_count, &_bounds, &block_offsets, &block_weights]()
+        {
+            int *counts = block_offsets.data() + ((size_t)block * tiles_count);
+            float *weights = block_weights.data() + ((size_t)block * tiles_count);
+            int face_end = std::min(faces_count, (block + 1) * faces_per_block);
+            for (int face = block * faces_per_block; face < face_end; face++)
+            {
+                FaceBounds tiles;
+                if (!tileRange(_bounds[face], tiles))
+                    continue;
+
+                for (int ty = tiles.y0; ty < tiles.y1; ty++)
+                {
+                    for (int tx = tiles.x0; tx < tiles.x1; tx++)
+                    {
+                        FaceBounds tile = getTileBounds((ty * this->tiles_x) + tx);
+                        int clipped_w = std::min(tile.x1, _bounds[face].x1) - std::max(tile.x0, _bounds[face].x0);
+                        int clipped_h = std::min(tile.y1, _bounds[face].y1) - std::max(tile.y0, _bounds[face].y0);
+
+                        counts[(ty * this->tiles_x) + tx]++;
+                        weights[(ty * this->tiles_x) + tx] += (clipped_w * clipped_h) + 1;
+                    }
+                }
+            }
+        });
+    }
+    counters.wait();
+
+    // Turn the counts into write offsets in place. Within a tile, lower
+    // blocks come first, which keeps each tile's list in face index order.
+    int running = 0;
+    for (int tile = 0; tile < tiles_count; tile++)
+    {
+        this->tile_offsets[tile] = running;
+        this->tile_weights[tile] = 0.0f;
+        for (int block = 0; block < blocks_count; block++)
+        {
+            size_t index = ((size_t)block * tiles_count) + tile;
+            int count = block_offsets[index];
+            block_offsets[index] = running;
+            running += count;
+            this->tile_weights[tile] += block_weights[index];
+        }
+    }
+    this->tile_offsets[tiles_count] = running;
+    this->tile_faces = std::vector<int>(running);
+
+    // Second pass: every block writes its face indices into its own slots.
+    TaskGroup writers;
+    for (int block = 0; block < blocks_count; block++)
+    {
+        writers.run([this, block, faces_count, faces_per_block, tiles_count, &_bounds, &block_offsets]()
+        {
+            int *offsets = block_offsets.data() + ((size_t)block * tiles_count);
+            int face_end = std::min(faces_count, (block + 1) * faces_per_block);
+            for (int face = block * faces_per_block; face < face_end; face++)
+            {
+                FaceBounds tiles;
+                if (!tileRange(_bounds[face], tiles))
+                    continue;
+
+                for (int ty = tiles.y0; ty < tiles.y1; ty++)
+                {
+                    for (int tx = tiles.x0; tx < tiles.x1; tx++)
+                    {
+                        this->tile_faces[offsets[(ty * this->tiles_x) + tx]++] = face;
+                    }
+                }
+            }
+        });
+    }
+    writers.wait();
+}
+
+int TileBins::getTilesCount()
+{
+    return this->tiles_x * this->tiles_y;
+}
+
+FaceBounds TileBins::getTileBounds(int _tile)
+{
+    int tx = _tile % this->tiles_x;
+    int ty = _tile / this->tiles_x;
+
+    return FaceBounds{
+        tx * this->tile_size,
+        ty * this->tile_size,
+        std::min((tx + 1) * this->tile_size, this->width),
+        std::min((ty + 1) * this->tile_size, this->height)};
+}
+
+const int *TileBins::tileFacesBegin(int _tile)
+{
+    return this->tile_faces.data() + this->tile_offsets[_tile];
+}
+
+const int *TileBins::tileFacesEnd(int _tile)
+{
+    return this->tile_faces.data() + this->tile_offsets[_tile + 1];
+}
+
+std::vector<float> TileBins::getTileWeights()
+{
+    return this->tile_weights;
+}
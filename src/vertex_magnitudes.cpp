@@ -0,0 +1,139 @@
+#include "vertex_magnitudes.h"
+#include "raster_kernel.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MAGNITUDE_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+// Vertices are measured in blocks of this many, one pool task per block.
+static const int VERTICES_PER_BLOCK = 65536;
+
+// Reference loop. Each distance is sqrtf((x*x + y*y) + z*z) in single
+// precision, the same operations the vector path does per lane.
+static void computeVertexDistancesScalar(const float *_vertices, int _count, float *_distances, float &_min, float &_max)
+{
+    for (int i = 0; i < _count; i++)
+    {
+        const float *vertex = _vertices + (i * 3);
+        float squares = (vertex[0] * vertex[0]) + (vertex[1] * vertex[1]);
+        float distance = std::sqrt(squares + (vertex[2] * vertex[2]));
+
+        _distances[i] = distance;
+        _min = std::min(_min, distance);
+        _max = std::max(_max, distance);
+    }
+}
+
+#ifdef MAGNITUDE_X86_DISPATCH
+
+// Eight vertices per iteration: x, y and z are gathered out of the packed
+// xyz array with a stride of three floats.
+__attribute__((target("avx2"))) static void computeVertexDistancesAvx2(const float *_vertices, int _count, float *_distances, float &_min, float &_max)
+{
+    const __m256i stride = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+    __m256 low = _mm256_set1_ps(_min);
+    __m256 high = _mm256_set1_ps(_max);
+
+    int i = 0;
+    for (; i + 8 <= _count; i += 8)
+    {
+        const float *base = _vertices + (i * 3);
+        __m256 x = _mm256_i32gather_ps(base, stride, 4);
+        __m256 y = _mm256_i32gather_ps(base + 1, stride, 4);
+        __m256 z = _mm256_i32gather_ps(base + 2, stride, 4);
+
+        __m256 squares = _mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y));
+        __m256 distance = _mm256_sqrt_ps(_mm256_add_ps(squares, _mm256_mul_ps(z, z)));
+
+        _mm256_storeu_ps(_distances + i, distance);
+        low = _mm256_min_ps(low, distance);
+        high = _mm256_max_ps(high, distance);
+    }
+
+    float lanes[8];
+    _mm256_storeu_ps(lanes, low);
+    _min = *std::min_element(lanes, lanes + 8);
+    _mm256_storeu_ps(lanes, high);
+    _max = *std::max_element(lanes, lanes + 8);
+
+    computeVertexDistancesScalar(_vertices + (i * 3), _count - i, _distances + i, _min, _max);
+}
+
+#endif
+
+void computeVertexDistances(const float *_vertices, int _count, float *_distances, float &_min, float &_max)
+{
+#ifdef MAGNITUDE_X86_DISPATCH
+    if (getSpanWriterLevel() >= SPAN_WRITER_AVX2)
+    {
+        computeVertexDistancesAvx2(_vertices, _count, _distances, _min, _max);
+        return;
+    }
+#endif
+    computeVertexDistancesScalar(_vertices, _count, _distances, _min, _max);
+}
+
+void VertexMagnitudes::build(const Model &_model)
+{
+    // Every mesh is cut into blocks, and the blocks of all meshes go to the
+    // pool together, so one large mesh is spread over all threads while
+    // small meshes fill in around it.
+    struct VertexBlock
+    {
+        int mesh;
+        int begin;
+        int count;
+    };
+
+    std::vector<VertexBlock> blocks;
+    this->mesh_offsets = std::vector<int>(_model.meshCount + 1, 0);
+
+    for (int mesh = 0; mesh < _model.meshCount; mesh++)
+    {
+        const Mesh &raster_mesh = _model.meshes[mesh];
+        const int vertex_count = raster_mesh.vertices ? raster_mesh.vertexCount : 0;
+
+        for (int begin = 0; begin < vertex_count; begin += VERTICES_PER_BLOCK)
+        {
+            blocks.push_back(VertexBlock{mesh, begin, std::min(VERTICES_PER_BLOCK, vertex_count - begin)});
+        }
+        this->mesh_offsets[mesh + 1] = this->mesh_offsets[mesh] + vertex_count;
+    }
+
+    const int blocks_count = blocks.size();
+    std::shared_ptr<std::vector<float>> distances = std::make_shared<std::vector<float>>(this->mesh_offsets[_model.meshCount]);
+
+    std::vector<float> block_min(blocks_count, FLT_MAX);
+    std::vector<float> block_max(blocks_count, -FLT_MAX);
+
+    TaskGroup measurers;
+    for (int block = 0; block < blocks_count; block++)
+    {
+        measurers.run([this, &_model, &blocks, block, &distances, &block_min, &block_max]()
+        {
+            const VertexBlock &range = blocks[block];
+            computeVertexDistances(
+                _model.meshes[range.mesh].vertices + (range.begin * 3),
+                range.count,
+                distances->data() + this->mesh_offsets[range.mesh] + range.begin,
+                block_min[block],
+                block_max[block]);
+        });
+    }
+    measurers.wait();
+
+    this->distances = std::shared_ptr<const float>(distances, distances->data());
+    this->distances_count = distances->size();
+    this->min_distance = blocks_count ? *std::min_element(block_min.begin(), block_min.end()) : 0.0f;
+    this->max_distance = blocks_count ? *std::max_element(block_max.begin(), block_max.end()) : 0.0f;
+}
+
+bool VertexMagnitudes::empty()
+{
+    return this->distances_count == 0;
+}
@@ -0,0 +1,360 @@
+#include "wav_writer.h"
+#include "raster_kernel.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define WAV_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+static const double PCM16_SCALE = 32767.0;
+static const double PCM24_SCALE = 8388607.0;
+
+// Header layout. The reserved chunk at DS64_OFFSET is JUNK in a plain WAV
+// file and ds64 in an RF64 one.
+static const int RIFF_SIZE_OFFSET = 4;
+static const int DS64_OFFSET = 12;
+static const int DS64_SIZE = 28;
+static const int FORMAT_OFFSET = DS64_OFFSET + 8 + DS64_SIZE;
+
+// Encoding slack past the end of the write buffer, see encodeWavSamples.
+static const int ENCODE_SLACK_BYTES = 16;
+
+static void putInt16(uint8_t *_at, int16_t _value)
+{
+    _at[0] = _value & 0xFF;
+    _at[1] = (_value >> 8) & 0xFF;
+}
+
+static void putInt32(uint8_t *_at, int32_t _value)
+{
+    _at[0] = _value & 0xFF;
+    _at[1] = (_value >> 8) & 0xFF;
+    _at[2] = (_value >> 16) & 0xFF;
+    _at[3] = (_value >> 24) & 0xFF;
+}
+
+static void putInt64(uint8_t *_at, int64_t _value)
+{
+    putInt32(_at, _value & 0xFFFFFFFF);
+    putInt32(_at + 4, (_value >> 32) & 0xFFFFFFFF);
+}
+
+// Reference encoders. Samples go through double precision so that the
+// scaling truncates exactly.
+static void encodeWavSamplesScalar(const float *_samples, int64_t _count, WavSampleFormat _format, uint8_t *_out)
+{
+    switch (_format)
+    {
+    case WAV_PCM24:
+        for (int64_t i = 0; i < _count; i++)
+        {
+            double sample = std::min(std::max((double)_samples[i], -1.0), 1.0);
+            int32_t value = sample * PCM24_SCALE;
+            _out[(i * 3)] = value & 0xFF;
+            _out[(i * 3) + 1] = (value >> 8) & 0xFF;
+            _out[(i * 3) + 2] = (value >> 16) & 0xFF;
+        }
+        break;
+    case WAV_FLOAT32:
+        // Float data is little endian, as is every target we build for.
+        std::memcpy(_out, _samples, _count * sizeof(float));
+        break;
+    default:
+        for (int64_t i = 0; i < _count; i++)
+        {
+            double sample = std::min(std::max((double)_samples[i], -1.0), 1.0);
+            putInt16(_out + (i * 2), sample * PCM16_SCALE);
+        }
+        break;
+    }
+}
+
+#ifdef WAV_X86_DISPATCH
+
+// Clamps and scales four floats in double precision, truncating to int32.
+__attribute__((target("avx2"))) static inline __m128i scaleAvx2(__m128 _samples, __m256d _scale)
+{
+    __m256d sample = _mm256_cvtps_pd(_samples);
+    sample = _mm256_min_pd(_mm256_max_pd(sample, _mm256_set1_pd(-1.0)), _mm256_set1_pd(1.0));
+    return _mm256_cvttpd_epi32(_mm256_mul_pd(sample, _scale));
+}
+
+__attribute__((target("avx2"))) static void encodeWavSamplesAvx2(const float *_samples, int64_t _count, WavSampleFormat _format, uint8_t *_out)
+{
+    const int64_t vector_count = _count & ~(int64_t)7;
+
+    switch (_format)
+    {
+    case WAV_PCM24:
+    {
+        const __m256d scale = _mm256_set1_pd(PCM24_SCALE);
+        // Keeps the low three bytes of each int32, in both 128 bit lanes.
+        const __m256i pack = _mm256_setr_epi8(
+            0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+            0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+        for (int64_t i = 0; i < vector_count; i += 8)
+        {
+            __m128i low = scaleAvx2(_mm_loadu_ps(_samples + i), scale);
+            __m128i high = scaleAvx2(_mm_loadu_ps(_samples + i + 4), scale);
+            __m256i packed = _mm256_shuffle_epi8(_mm256_set_m128i(high, low), pack);
+
+            _mm_storeu_si128((__m128i *)(_out + (i * 3)), _mm256_castsi256_si128(packed));
+            _mm_storeu_si128((__m128i *)(_out + (i * 3) + 12), _mm256_extracti128_si256(packed, 1));
+        }
+        break;
+    }
+    case WAV_FLOAT32:
+        break;
+    default:
+    {
+        const __m256d scale = _mm256_set1_pd(PCM16_SCALE);
+        for (int64_t i = 0; i < vector_count; i += 8)
+        {
+            __m128i low = scaleAvx2(_mm_loadu_ps(_samples + i), scale);
+            __m128i high = scaleAvx2(_mm_loadu_ps(_samples + i + 4), scale);
+            _mm_storeu_si128((__m128i *)(_out + (i * 2)), _mm_packs_epi32(low, high));
+        }
+        break;
+    }
+    }
+
+    if (_format == WAV_FLOAT32)
+    {
+        encodeWavSamplesScalar(_samples, _count, _format, _out);
+        return;
+    }
+
+    const int bytes_per_sample = (_format == WAV_PCM24) ? 3 : 2;
+    encodeWavSamplesScalar(_samples + vector_count, _count - vector_count, _format, _out + (vector_count * bytes_per_sample));
+}
+
+#endif
+
+void encodeWavSamples(const float *_samples, int64_t _count, WavSampleFormat _format, uint8_t *_out)
+{
+#ifdef WAV_X86_DISPATCH
+    if (getSpanWriterLevel() >= SPAN_WRITER_AVX2)
+    {
+        encodeWavSamplesAvx2(_samples, _count, _format, _out);
+        return;
+    }
+#endif
+    encodeWavSamplesScalar(_samples, _count, _format, _out);
+}
+
+WavWriter::WavWriter()
+{
+    this->sample_rate = 0;
+    this->channels_count = 0;
+    this->format = WAV_PCM16;
+    this->frames_count = 0;
+    this->fact_offset = 0;
+    this->buffer_used = 0;
+    this->failed = false;
+}
+
+WavWriter::~WavWriter()
+{
+    close();
+}
+
+int WavWriter::getBytesPerSample() const
+{
+    switch (this->format)
+    {
+    case WAV_PCM24:
+        return 3;
+    case WAV_FLOAT32:
+        return 4;
+    default:
+        return 2;
+    }
+}
+
+// Lays out the header of a plain WAV file with zero sizes.
+void WavWriter::buildHeader()
+{
+    const bool is_float = (this->format == WAV_FLOAT32);
+    const int format_size = is_float ? 18 : 16;
+    const int block_align = this->channels_count * getBytesPerSample();
+    // Every format other than PCM needs a fact chunk with the length in
+    // frames.
+    const int fact_size = is_float ? 8 + 4 : 0;
+
+    this->header = std::vector<uint8_t>(FORMAT_OFFSET + 8 + format_size + fact_size + 8, 0);
+    uint8_t *at = this->header.data();
+
+    std::memcpy(at, "RIFF", 4);
+    std::memcpy(at + 8, "WAVE", 4);
+
+    std::memcpy(at + DS64_OFFSET, "JUNK", 4);
+    putInt32(at + DS64_OFFSET + 4, DS64_SIZE);
+
+    at += FORMAT_OFFSET;
+    std::memcpy(at, "fmt ", 4);
+    putInt32(at + 4, format_size);
+    putInt16(at + 8, is_float ? 3 : 1);
+    putInt16(at + 10, this->channels_count);
+    putInt32(at + 12, this->sample_rate);
+    putInt32(at + 16, this->sample_rate * block_align);
+    putInt16(at + 20, block_align);
+    putInt16(at + 22, getBytesPerSample() * 8);
+
+    at += 8 + format_size;
+    this->fact_offset = 0;
+    if (is_float)
+    {
+        this->fact_offset = at - this->header.data();
+        std::memcpy(at, "fact", 4);
+        putInt32(at + 4, 4);
+        at += fact_size;
+    }
+
+    std::memcpy(at, "data", 4);
+}
+
+bool WavWriter::open(std::string _path, int _sample_rate, int _channels_count, WavSampleFormat _format)
+{
+    close();
+
+    this->sample_rate = _sample_rate;
+    this->channels_count = _channels_count;
+    this->format = _format;
+    this->frames_count = 0;
+    this->buffer_used = 0;
+    this->failed = false;
+
+    this->file.open(_path, std::ios::binary | std::ios::trunc);
+    if (!this->file)
+        return false;
+
+    buildHeader();
+    this->buffer = std::vector<uint8_t>(WAV_WRITE_BUFFER_BYTES + ENCODE_SLACK_BYTES);
+
+    this->file.write((const char *)this->header.data(), this->header.size());
+    this->failed = !this->file;
+    return !this->failed;
+}
+
+void WavWriter::flush()
+{
+    if (this->buffer_used == 0)
+        return;
+
+    this->file.write((const char *)this->buffer.data(), this->buffer_used);
+    this->failed = this->failed || !this->file;
+    this->buffer_used = 0;
+}
+
+bool WavWriter::writeMono(const float *_samples, int64_t _count)
+{
+    if (!this->file.is_open() || this->failed)
+        return false;
+
+    const int sample_bytes = getBytesPerSample();
+    const int frame_bytes = sample_bytes * this->channels_count;
+
+    int64_t written = 0;
+    while (written < _count)
+    {
+        int64_t room = (WAV_WRITE_BUFFER_BYTES - this->buffer_used) / frame_bytes;
+        if (room == 0)
+        {
+            flush();
+            continue;
+        }
+
+        const int64_t piece = std::min(room, _count - written);
+        uint8_t *out = this->buffer.data() + this->buffer_used;
+
+        if (this->channels_count == 1)
+        {
+            encodeWavSamples(_samples + written, piece, this->format, out);
+        }
+        else
+        {
+            // Encoded once, then copied onto every channel.
+            this->encoded.resize((piece * sample_bytes) + ENCODE_SLACK_BYTES);
+            encodeWavSamples(_samples + written, piece, this->format, this->encoded.data());
+
+            for (int64_t i = 0; i < piece; i++)
+            {
+                const uint8_t *sample = this->encoded.data() + (i * sample_bytes);
+                for (int channel = 0; channel < this->channels_count; channel++)
+                {
+                    std::memcpy(out + (i * frame_bytes) + (channel * sample_bytes), sample, sample_bytes);
+                }
+            }
+        }
+
+        this->buffer_used += piece * frame_bytes;
+        written += piece;
+    }
+
+    this->frames_count += _count;
+    return !this->failed;
+}
+
+bool WavWriter::close()
+{
+    if (!this->file.is_open())
+        return true;
+
+    flush();
+
+    int64_t data_size = this->frames_count * this->channels_count * getBytesPerSample();
+
+    // Chunks have even sizes; an odd data chunk gets a pad byte.
+    if (data_size % 2 != 0)
+    {
+        this->file.put(0);
+    }
+
+    const int64_t riff_size = (this->header.size() - 8) + data_size + (data_size % 2);
+    uint8_t *at = this->header.data();
+    uint8_t *data_size_at = at + this->header.size() - 4;
+
+    if (riff_size > UINT32_MAX)
+    {
+        std::memcpy(at, "RF64", 4);
+        putInt32(at + RIFF_SIZE_OFFSET, -1);
+        putInt32(data_size_at, -1);
+
+        std::memcpy(at + DS64_OFFSET, "ds64", 4);
+        putInt64(at + DS64_OFFSET + 8, riff_size);
+        putInt64(at + DS64_OFFSET + 16, data_size);
+        putInt64(at + DS64_OFFSET + 24, this->frames_count);
+        putInt32(at + DS64_OFFSET + 32, 0);
+    }
+    else
+    {
+        putInt32(at + RIFF_SIZE_OFFSET, riff_size);
+        putInt32(data_size_at, data_size);
+    }
+
+    // A length past 32 bits is left to the ds64 chunk's sample count.
+    if (this->fact_offset != 0)
+    {
+        putInt32(at + this->fact_offset + 8, (this->frames_count > UINT32_MAX) ? -1 : (int32_t)(uint32_t)this->frames_count);
+    }
+
+    this->file.seekp(0);
+    this->file.write((const char *)this->header.data(), this->header.size());
+
+    bool written = !this->failed && (bool)this->file;
+    this->file.close();
+
+    this->buffer.clear();
+    this->buffer.shrink_to_fit();
+    this->encoded.clear();
+    this->encoded.shrink_to_fit();
+    return written;
+}
+
+int64_t WavWriter::getFramesCount() const
+{
+    return this->frames_count;
+}
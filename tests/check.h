@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdarg>
+#include <cstdio>
+
+// Failure reporting shared by the test binaries under tests/. Every failed
+// check prints one line; the binary then exits through checksResult.
+
+inline int &failuresCount()
+{
+    static int failures_count = 0;
+    return failures_count;
+}
+
+inline void fail(const char *_format, ...) __attribute__((format(printf, 1, 2)));
+
+inline void fail(const char *_format, ...)
+{
+    va_list arguments;
+    va_start(arguments, _format);
+    printf("FAIL: ");
+    vprintf(_format, arguments);
+    printf("\n");
+    va_end(arguments);
+    failuresCount()++;
+}
+
+// Exit code of a test binary: 1 if any check failed.
+inline int checksResult()
+{
+    if (failuresCount() > 0)
+    {
+        printf("%d check(s) failed\n", failuresCount());
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
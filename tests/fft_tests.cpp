@@ -0,0 +1,75 @@
+// Checks RealFft, which the inverse FFT synthesis mode runs on, against a
+// naive inverse DFT in double precision, for every power-of-two size from
+// 2 to 4096:
+//
+//     fft_tests
+//
+// Prints every failed check and exits with 1 if there was any.
+
+#include "check.h"
+#include "fft.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// x[n] = sum over k of X[k] e^(2 pi i k n / N), over the Hermitian
+// spectrum whose first N / 2 + 1 bins are given.
+static std::vector<double> naiveInverseDft(const std::vector<float> &_real, const std::vector<float> &_imag, int _size)
+{
+    std::vector<double> out(_size);
+    for (int n = 0; n < _size; n++)
+    {
+        double sum = _real[0] + (((n & 1) == 0) ? _real[_size / 2] : -_real[_size / 2]);
+        for (int k = 1; k < _size / 2; k++)
+        {
+            double angle = (2.0 * M_PI * (double)(((int64_t)k * n) % _size)) / _size;
+            sum += 2.0 * ((_real[k] * std::cos(angle)) - (_imag[k] * std::sin(angle)));
+        }
+        out[n] = sum;
+    }
+    return out;
+}
+
+static void checkRealFft()
+{
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> bin(-1.0f, 1.0f);
+
+    for (int size = 2; size <= 4096; size *= 2)
+    {
+        std::vector<float> real(size / 2 + 1), imag(size / 2 + 1);
+        for (int k = 0; k <= size / 2; k++)
+        {
+            real[k] = bin(random);
+            imag[k] = bin(random);
+        }
+        // The spectrum of a real signal is real at DC and at Nyquist.
+        imag[0] = 0.0f;
+        imag[size / 2] = 0.0f;
+
+        std::vector<double> expected = naiveInverseDft(real, imag, size);
+
+        RealFft fft(size);
+        std::vector<float> out(size);
+        fft.inverse(real.data(), imag.data(), out.data());
+
+        // Float rounding grows with the transform's length and the sum of
+        // its bins' magnitudes.
+        double tolerance = 1e-7 * size * std::log2((double)size + 1.0);
+        double max_error = 0.0;
+        for (int n = 0; n < size; n++)
+            max_error = std::max(max_error, std::fabs(out[n] - expected[n]));
+
+        if (max_error > tolerance)
+            fail("RealFft(%d): error %g over %g", size, max_error, tolerance);
+    }
+    printf("RealFft: checked\n");
+}
+
+int main()
+{
+    checkRealFft();
+    return checksResult();
+}
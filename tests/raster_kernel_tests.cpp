@@ -0,0 +1,169 @@
+// Checks rasterizeTriangle against the exact magnitude plane, computed in
+// double precision, for every element type: every pixel a triangle writes
+// must hold the plane's value at that pixel, clamped to 0-magnitude_max,
+// to within one step of the element type. Slivers and triangles a few
+// pixels across have the steepest gradients, so they are the cases drawn.
+//
+//     raster_kernel_tests
+//
+// Prints every failed check and exits with 1 if there was any.
+
+#include "check.h"
+#include "raster_kernel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+static const int BUFFER_SIZE = 512;
+
+// Stored element back on the 0-magnitude_max scale of RasterVertex::z.
+static double storedMagnitude(uint8_t _value)
+{
+    return _value;
+}
+
+static double storedMagnitude(uint16_t _value)
+{
+    return _value;
+}
+
+static double storedMagnitude(float _value)
+{
+    return (double)_value * SampleTraits<float>::magnitude_max;
+}
+
+// Pixels around a triangle's bounds that are cleared, clipped to and
+// checked, so a write just outside them is caught.
+static const int BOUNDS_MARGIN = 2;
+
+// Rasterizes L, M, H (sorted by y) into _buffer, after filling _region of
+// it with _fill.
+template <typename T>
+static void rasterizeInto(const RasterVertex &L, const RasterVertex &M, const RasterVertex &H, const FaceBounds &_region, T _fill, std::vector<T> &_buffer)
+{
+    _buffer.resize((size_t)BUFFER_SIZE * BUFFER_SIZE);
+    for (int y = _region.y0; y < _region.y1; y++)
+        std::fill(_buffer.begin() + ((size_t)y * BUFFER_SIZE) + _region.x0, _buffer.begin() + ((size_t)y * BUFFER_SIZE) + _region.x1, _fill);
+    rasterizeTriangle<T, DynamicLayout>(L, M, H, _region, _buffer.data(), DynamicLayout(BUFFER_SIZE));
+}
+
+// False, after reporting the first bad pixel, if the triangle is not
+// written as its plane.
+template <typename T>
+static bool checkTriangle(RasterVertex _corners[3], const char *_type_name)
+{
+    std::sort(_corners, _corners + 3, [](const RasterVertex &_a, const RasterVertex &_b) { return _a.y < _b.y; });
+    const RasterVertex &L = _corners[0];
+    const RasterVertex &M = _corners[1];
+    const RasterVertex &H = _corners[2];
+
+    const int64_t area2 = ((int64_t)(M.x - L.x) * (H.y - L.y)) - ((int64_t)(H.x - L.x) * (M.y - L.y));
+    if (area2 == 0)
+        return true;
+    const double dzdx = (((double)(M.z - L.z) * (H.y - L.y)) - ((double)(H.z - L.z) * (M.y - L.y))) / area2;
+    const double dzdy = (((double)(M.x - L.x) * (H.z - L.z)) - ((double)(H.x - L.x) * (M.z - L.z))) / area2;
+
+    const int x_min = std::min({L.x, M.x, H.x});
+    const int x_max = std::max({L.x, M.x, H.x});
+    const FaceBounds region = {
+        std::max(x_min - BOUNDS_MARGIN, 0), std::max(L.y - BOUNDS_MARGIN, 0),
+        std::min(x_max + BOUNDS_MARGIN + 1, BUFFER_SIZE), std::min(H.y + BOUNDS_MARGIN + 1, BUFFER_SIZE)};
+
+    // A pixel was written if it changed from either fill value.
+    static std::vector<T> low, high;
+    rasterizeInto<T>(L, M, H, region, (T)0, low);
+    rasterizeInto<T>(L, M, H, region, (T)SampleTraits<T>::max_value, high);
+
+    for (int y = region.y0; y < region.y1; y++)
+    {
+        for (int x = region.x0; x < region.x1; x++)
+        {
+            const size_t index = ((size_t)y * BUFFER_SIZE) + x;
+            if (low[index] == (T)0 && high[index] == (T)SampleTraits<T>::max_value)
+                continue;
+
+            if (x < x_min || x > x_max || y < L.y || y > H.y)
+            {
+                fail("%s: triangle (%d,%d,%d) (%d,%d,%d) (%d,%d,%d) writes (%d,%d), outside its bounds",
+                     _type_name, L.x, L.y, L.z, M.x, M.y, M.z, H.x, H.y, H.z, x, y);
+                return false;
+            }
+
+            const T written = (low[index] != (T)0) ? low[index] : high[index];
+            const double plane = L.z + (dzdx * (x - L.x)) + (dzdy * (y - L.y));
+            const double expected = std::min(std::max(plane, 0.0), (double)SampleTraits<T>::magnitude_max);
+            // Integer elements truncate; the fixed point gradient is
+            // rounded to 1 / 2^fixed_shift per pixel stepped.
+            const double tolerance = 1.0 + ((std::abs(x - L.x) + std::abs(y - L.y)) / (double)(1 << SampleTraits<T>::fixed_shift));
+            if (std::fabs(storedMagnitude(written) - expected) > tolerance)
+            {
+                fail("%s: triangle (%d,%d,%d) (%d,%d,%d) (%d,%d,%d) writes %g at (%d,%d), the plane is %g",
+                     _type_name, L.x, L.y, L.z, M.x, M.y, M.z, H.x, H.y, H.z, storedMagnitude(written), x, y, expected);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Corners drawn inside a _width by _height box placed at random, with
+// magnitudes over the whole 0-magnitude_max range.
+template <typename T>
+static void checkRandomTriangles(std::mt19937 &_random, int _count, int _width, int _height, const char *_shape, const char *_type_name)
+{
+    std::uniform_int_distribution<int> origin_x(0, BUFFER_SIZE - _width);
+    std::uniform_int_distribution<int> origin_y(0, BUFFER_SIZE - _height);
+    std::uniform_int_distribution<int> offset_x(0, _width - 1);
+    std::uniform_int_distribution<int> offset_y(0, _height - 1);
+    std::uniform_int_distribution<int> magnitude(0, SampleTraits<T>::magnitude_max);
+
+    for (int i = 0; i < _count; i++)
+    {
+        const int x = origin_x(_random);
+        const int y = origin_y(_random);
+        RasterVertex corners[3];
+        for (RasterVertex &corner : corners)
+            corner = {x + offset_x(_random), y + offset_y(_random), magnitude(_random)};
+
+        if (!checkTriangle<T>(corners, _type_name))
+        {
+            fail("%s: %s triangles are not written as their plane", _type_name, _shape);
+            return;
+        }
+    }
+}
+
+template <typename T>
+static void checkElementType(const char *_type_name)
+{
+    std::mt19937 random(4321);
+
+    checkRandomTriangles<T>(random, 50000, 3, 3, "1-2 pixel", _type_name);
+    checkRandomTriangles<T>(random, 50000, 9, 9, "tiny", _type_name);
+    checkRandomTriangles<T>(random, 20000, 3, 500, "tall sliver", _type_name);
+    checkRandomTriangles<T>(random, 20000, 500, 3, "wide sliver", _type_name);
+
+    // A 16 bit scale triangle whose gradient wrapped the int32 span step,
+    // written as 0 at M, a 1 pixel step across a full range ramp, and a
+    // single row.
+    auto onScale = [](int _z) { return (int)(((int64_t)_z * SampleTraits<T>::magnitude_max) / 65535); };
+    RasterVertex wrapping[3] = {{390, 171, onScale(20411)}, {389, 172, onScale(65447)}, {385, 178, onScale(17328)}};
+    checkTriangle<T>(wrapping, _type_name);
+    RasterVertex steep[3] = {{100, 100, 0}, {101, 101, SampleTraits<T>::magnitude_max}, {100, 300, 0}};
+    checkTriangle<T>(steep, _type_name);
+    RasterVertex flat[3] = {{10, 50, SampleTraits<T>::magnitude_max}, {500, 50, 0}, {11, 51, SampleTraits<T>::magnitude_max}};
+    checkTriangle<T>(flat, _type_name);
+
+    printf("rasterizeTriangle %s: checked\n", _type_name);
+}
+
+int main()
+{
+    checkElementType<uint8_t>("uint8");
+    checkElementType<uint16_t>("uint16");
+    checkElementType<float>("float");
+
+    return checksResult();
+}
@@ -0,0 +1,76 @@
+// Checks that every span writer level the host supports (see
+// setSpanWriterLevel, and MUSER_SIMD) writes the same values as
+// writeSpanScalar, for every element type:
+//
+//     span_writer_tests
+//
+// Prints every failed check and exits with 1 if there was any.
+
+#include "check.h"
+#include "raster_kernel.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+template <typename T>
+static void checkSpanWriter(SpanWriterLevel _level, const char *_type_name)
+{
+    const int32_t max_fixed = SampleTraits<T>::max_fixed;
+    // Starts below 0, inside and above the range, with ramps steep enough
+    // to cross it within a span but not to overflow int32.
+    const int32_t starts[] = {-max_fixed / 4, 0, 1, max_fixed / 3, max_fixed - 1, max_fixed, max_fixed + max_fixed / 8};
+    const int32_t steps[] = {-max_fixed / 128, -max_fixed / 1000, -1, 0, 1, 12345, max_fixed / 1000, max_fixed / 128};
+    const int max_count = 70;
+
+    std::vector<T> expected(max_count + 1);
+    std::vector<T> written(max_count + 1);
+
+    for (int32_t z : starts)
+    {
+        for (int32_t dz : steps)
+        {
+            for (int count = 0; count <= max_count; count++)
+            {
+                // The element past the span must be left alone.
+                std::fill(expected.begin(), expected.end(), (T)7);
+                std::fill(written.begin(), written.end(), (T)7);
+
+                writeSpanScalar<T>(expected.data(), count, z, dz);
+                writeSpan<T>(written.data(), count, z, dz);
+
+                if (memcmp(expected.data(), written.data(), expected.size() * sizeof(T)) != 0)
+                {
+                    fail("span writer %s, %s: count %d, z %d, dz %d differs from the scalar writer",
+                         getSpanWriterName(_level), _type_name, count, z, dz);
+                    return;
+                }
+            }
+        }
+    }
+}
+
+static void checkSpanWriters()
+{
+    const SpanWriterLevel initial_level = getSpanWriterLevel();
+
+    for (int level = SPAN_WRITER_SCALAR; level <= SPAN_WRITER_AVX512; level++)
+    {
+        if (!setSpanWriterLevel((SpanWriterLevel)level))
+        {
+            printf("span writer %s: not supported here, skipped\n", getSpanWriterName((SpanWriterLevel)level));
+            continue;
+        }
+        checkSpanWriter<uint8_t>((SpanWriterLevel)level, "uint8");
+        checkSpanWriter<uint16_t>((SpanWriterLevel)level, "uint16");
+        checkSpanWriter<float>((SpanWriterLevel)level, "float");
+        printf("span writer %s: checked\n", getSpanWriterName((SpanWriterLevel)level));
+    }
+
+    setSpanWriterLevel(initial_level);
+}
+
+int main()
+{
+    checkSpanWriters();
+    return checksResult();
+}
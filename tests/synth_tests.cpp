@@ -0,0 +1,80 @@
+// Checks SynthEngine's block-partitioned render: rendered on the thread
+// pool, it is bit-identical to one serial renderBlock over all samples, and
+// stays within float rounding of a sum of sin() per row and sample, across
+// SYNTH_BLOCK_SAMPLES seams and rows lighting up and going dark:
+//
+//     synth_tests
+//
+// Prints every failed check and exits with 1 if there was any.
+
+#include "check.h"
+#include "synth_engine.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+static void checkSynthEngine()
+{
+    const int rows = 37;
+    const int columns = 23;
+    const int64_t samples_count = 5 * SYNTH_BLOCK_SAMPLES + 321;
+
+    // Rows light up and go dark from column to column, so phasors are both
+    // carried over and restarted.
+    Spectrogram spectrogram(columns, rows, SPECTROGRAM_FLOAT);
+    float *cells = spectrogram.data<float>();
+    for (int row = 0; row < rows; row++)
+        for (int column = 0; column < columns; column++)
+            cells[((size_t)row * columns) + column] = (((row * 7) + (column * 3)) % 5 < 3) ? (float)(1 + ((row + column) % 4)) : 0.0f;
+
+    ActiveRows active_rows;
+    active_rows.build(spectrogram);
+
+    std::vector<double> frequencies(rows);
+    for (int row = 0; row < rows; row++)
+        frequencies[row] = 0.01 + ((M_PI - 0.02) * row) / rows;
+
+    SynthEngine engine(frequencies, active_rows, samples_count);
+    for (int column = 0; column < columns; column++)
+    {
+        float *amplitudes = engine.getAmplitudes(column);
+        const int *row = active_rows.columnRowsBegin(column);
+        for (int i = 0; row + i != active_rows.columnRowsEnd(column); i++)
+            amplitudes[i] = cells[((size_t)row[i] * columns) + column] / rows;
+    }
+
+    std::vector<float> out(samples_count);
+    engine.render(out.data());
+
+    std::vector<float> serial(samples_count);
+    engine.renderBlock(0, (int)samples_count, serial.data());
+    if (memcmp(out.data(), serial.data(), out.size() * sizeof(float)) != 0)
+        fail("SynthEngine: the pooled render differs from a serial renderBlock");
+
+    double max_error = 0.0;
+    for (int64_t n = 0; n < samples_count; n++)
+    {
+        int column = engine.columnOf(n);
+        double expected = 0.0;
+        for (int row = 0; row < rows; row++)
+            expected += (cells[((size_t)row * columns) + column] / rows) * std::sin(frequencies[row] * (double)n);
+        max_error = std::max(max_error, std::fabs(out[n] - expected));
+    }
+
+    // The phasors are float and are only put back on their exact phase
+    // every SYNTH_BLOCK_SAMPLES, so allow for a block's worth of rounding.
+    const double tolerance = 1e-4;
+    if (max_error > tolerance)
+        fail("SynthEngine: error %g over %g", max_error, tolerance);
+    printf("SynthEngine: checked\n");
+}
+
+int main()
+{
+    checkSynthEngine();
+
+    return checksResult();
+}
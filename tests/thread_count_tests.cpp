@@ -0,0 +1,155 @@
+// Checks that rasterizing and exporting do not depend on the number of
+// worker threads: a muse exports byte-identical .spec and .wav files with
+// one worker and with [threads] of them (default: one per hardware thread,
+// at least 2), for every buffer format and synthesis mode:
+//
+//     thread_count_tests [threads]
+//
+// Prints every failed check and exits with 1 if there was any.
+
+#include "check.h"
+#include "muse.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// A bumpy UV sphere, one unindexed mesh whose texcoords cover the whole
+// buffer, so rasterizing it touches every tile. The vectors back the mesh
+// and must outlive any muse using it.
+struct SphereModel
+{
+    std::vector<float> vertices;
+    std::vector<float> texcoords;
+    Mesh mesh = Mesh{};
+    Model model = Model{};
+
+    SphereModel(int _slices, int _stacks)
+    {
+        auto addCorner = [&](int _slice, int _stack)
+        {
+            double u = (double)_slice / _slices;
+            double v = (double)_stack / _stacks;
+            double theta = u * 2.0 * M_PI;
+            double phi = v * M_PI;
+            double radius = 1.0 + (0.3 * std::sin(5.0 * theta) * std::sin(3.0 * phi));
+
+            this->vertices.push_back((float)(radius * std::sin(phi) * std::cos(theta)));
+            this->vertices.push_back((float)(radius * std::cos(phi)));
+            this->vertices.push_back((float)(radius * std::sin(phi) * std::sin(theta)));
+            this->texcoords.push_back((float)u);
+            this->texcoords.push_back((float)v);
+        };
+
+        for (int stack = 0; stack < _stacks; stack++)
+        {
+            for (int slice = 0; slice < _slices; slice++)
+            {
+                addCorner(slice, stack);
+                addCorner(slice, stack + 1);
+                addCorner(slice + 1, stack + 1);
+
+                addCorner(slice, stack);
+                addCorner(slice + 1, stack + 1);
+                addCorner(slice + 1, stack);
+            }
+        }
+
+        this->mesh.vertexCount = (int)(this->vertices.size() / 3);
+        this->mesh.triangleCount = this->mesh.vertexCount / 3;
+        this->mesh.vertices = this->vertices.data();
+        this->mesh.texcoords = this->texcoords.data();
+
+        this->model.meshCount = 1;
+        this->model.meshes = &this->mesh;
+    }
+};
+
+static std::vector<char> readFile(const std::string &_path)
+{
+    std::ifstream file(_path, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+// Rasterizes and exports _model with _threads_count workers, returning the
+// .spec and .wav files' contents.
+static bool exportWithThreads(
+    const Model &_model,
+    SpectrogramFormat _format,
+    SynthesisMode _mode,
+    int _threads_count,
+    std::vector<char> &_image,
+    std::vector<char> &_audio)
+{
+    ThreadPool::configure(_threads_count, false);
+
+    Muse muse(0, _model, Texture2D{}, 640, 480, _format);
+    muse.setSynthesisMode(_mode);
+    muse.setDuration(2.0);
+    muse.setSampleRate(22050);
+    muse.setChannelsCount(2);
+    muse.setImageFormat(IMAGE_SPECTROGRAM);
+    muse.setWavFormat(WAV_FLOAT32);
+
+    muse.rasterizeBuffer();
+    const std::string name = "core_tests_" + std::to_string(_threads_count);
+    if (!muse.bufferReady() || !muse.exportImage(name) || !muse.exportAudio(name))
+        return false;
+
+    _image = readFile(name + ".spec");
+    _audio = readFile(name + ".wav");
+    remove((name + ".spec").c_str());
+    remove((name + ".wav").c_str());
+    return !_image.empty() && !_audio.empty();
+}
+
+static void checkThreadCounts(int _threads_count)
+{
+    SphereModel sphere(160, 90);
+
+    const struct
+    {
+        SpectrogramFormat format;
+        const char *name;
+    } formats[] = {{SPECTROGRAM_UINT8, "uint8"}, {SPECTROGRAM_UINT16, "uint16"}, {SPECTROGRAM_FLOAT, "float"}};
+    const struct
+    {
+        SynthesisMode mode;
+        const char *name;
+    } modes[] = {{SYNTHESIS_OSCILLATOR_BANK, "oscillator"}, {SYNTHESIS_INVERSE_FFT, "ifft"}};
+
+    for (const auto &format : formats)
+    {
+        for (const auto &mode : modes)
+        {
+            std::vector<char> serial_image, serial_audio, parallel_image, parallel_audio;
+            if (!exportWithThreads(sphere.model, format.format, mode.mode, 1, serial_image, serial_audio) ||
+                !exportWithThreads(sphere.model, format.format, mode.mode, _threads_count, parallel_image, parallel_audio))
+            {
+                fail("threads, %s, %s: export failed", format.name, mode.name);
+                continue;
+            }
+
+            if (serial_image != parallel_image)
+                fail("threads, %s, %s: .spec differs between 1 and %d threads", format.name, mode.name, _threads_count);
+            if (serial_audio != parallel_audio)
+                fail("threads, %s, %s: .wav differs between 1 and %d threads", format.name, mode.name, _threads_count);
+        }
+    }
+    printf("1 against %d threads: checked\n", _threads_count);
+}
+
+int main(int argc, char **argv)
+{
+    int threads_count = (argc > 1) ? atoi(argv[1]) : 0;
+    if (threads_count <= 0)
+        threads_count = std::max(2, ThreadPool::instance().getThreadsCount());
+
+    checkThreadCounts(threads_count);
+    return checksResult();
+}
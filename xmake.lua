@@ -19,22 +19,45 @@ if is_plat("linux") then
 end
 
 -- ==========================================
--- Target
+-- Core library
 -- ==========================================
 
+-- Rasterizing, synthesis and export: everything a Muse does without a
+-- window, a GL context or an audio device. Only raylib's headers are used,
+-- for its Model and Mesh types; nothing links against raylib.
+target("muser-core")
+    set_kind("static")
+
+    add_files("src/*.cpp")
+    remove_files("src/main.cpp")
+    remove_files("src/muse_gui.cpp")
+    remove_files("src/play_audio.cpp")
+    remove_files("src/model_import.cpp")
+
+    add_includedirs("src/headers", {public = true})
+    add_includedirs("lib/raylib/include", {public = true})
+
+    if is_plat("linux") then
+        add_syslinks("pthread", {public = true})
+    end
+
+-- ==========================================
+-- Targets
+-- ==========================================
+
+-- The raylib GUI, with the parts of Muse that need the window, GL context
+-- or audio device.
 target("muser")
     set_kind("binary")
+    add_deps("muser-core")
 
-    -- Source files (recursive)
-    add_files("src/**.cpp")
-    add_files("src/**.cc")
-    add_files("src/**.c")
+    add_files("src/main.cpp")
+    add_files("src/muse_gui.cpp")
+    add_files("src/play_audio.cpp")
+    add_files("src/model_import.cpp")
 
     -- Include directories
-    add_includedirs("src/headers")
-    add_includedirs("lib/raylib/include")
     add_includedirs("lib/raygui/include")
-    add_includedirs("lib/AudioFile")
 
     -- Link raylib static library
     add_links("raylib")
@@ -55,3 +78,41 @@ target("muser")
         local resdir = "res"
         os.cp(path.join(resdir, "**"), target:targetdir())
     end)
+
+-- Headless renderer for machines without a display or sound card:
+-- xmake build muser-cli && xmake run muser-cli [options] <model.obj | spectrogram>
+target("muser-cli")
+    set_kind("binary")
+    add_deps("muser-core")
+
+    add_files("src/cli/*.cpp")
+
+-- ==========================================
+-- Benchmarks (not built by default)
+-- ==========================================
+
+-- xmake build image_bench && xmake run image_bench [width] [height] [uint8|uint16|float]
+target("image_bench")
+    set_kind("binary")
+    set_default(false)
+
+    add_deps("muser-core")
+
+    add_files("bench/image_bench.cpp")
+
+-- ==========================================
+-- Tests (not built by default)
+-- ==========================================
+
+-- One binary per file under tests/, each exiting with 1 if a check fails:
+-- xmake build -g tests && xmake run <name> [arguments]
+for _, name in ipairs({"fft_tests", "raster_kernel_tests", "span_writer_tests", "synth_tests", "thread_count_tests"}) do
+    target(name)
+        set_kind("binary")
+        set_default(false)
+        set_group("tests")
+
+        add_deps("muser-core")
+
+        add_files("tests/" .. name .. ".cpp")
+end